@@ -0,0 +1,257 @@
+#include "ASTCache.h"
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static uint64_t fnv1a(uint64_t h, const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t fnv1a(uint64_t h, const std::string& s) {
+    // The terminator keeps ("ab", "c") and ("a", "bc") apart
+    return fnv1a(h, s.c_str(), s.size() + 1);
+}
+
+ASTCache::ASTCache(const std::string& dir, unsigned long long maxBytes)
+    : dir_(dir), maxBytes_(maxBytes) {
+    if (mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Can't create AST cache directory: " << dir_ << std::endl;
+    }
+}
+
+std::string ASTCache::absolutePath(const std::string& path) {
+    if (!path.empty() && path[0] == '/') {
+        return path;
+    }
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return path;
+    }
+    return std::string(cwd) + "/" + path;
+}
+
+std::string ASTCache::key(const std::string& sourceFile, const std::vector<std::string>& args,
+                          unsigned parseOptions) const {
+    std::ifstream in(sourceFile, std::ios::binary);
+    if (!in) {
+        return "";
+    }
+
+    // AST files are only readable by the libclang that wrote them
+    CXString version = clang_getClangVersion();
+    uint64_t h = fnv1a(1469598103934665603ULL, clang_getCString(version));
+    clang_disposeString(version);
+
+    h = fnv1a(h, sourceFile);
+    char buf[65536];
+    while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+        h = fnv1a(h, buf, in.gcount());
+    }
+    for (const auto& arg : args) {
+        h = fnv1a(h, arg);
+    }
+    h = fnv1a(h, std::to_string(parseOptions));
+
+    char key[17];
+    snprintf(key, sizeof(key), "%016" PRIx64, h);
+    return key;
+}
+
+CXTranslationUnit ASTCache::load(CXIndex index, const std::string& key) {
+    if (key.empty() || access(astPath(key).c_str(), R_OK) != 0) {
+        return nullptr;
+    }
+    if (!depsUnchanged(key)) {
+        remove(key);
+        return nullptr;
+    }
+
+    CXTranslationUnit tu = nullptr;
+    if (clang_createTranslationUnit2(index, astPath(key).c_str(), &tu) != CXError_Success) {
+        remove(key);
+        return nullptr;
+    }
+
+    // The mtime is the LRU clock
+    utimensat(AT_FDCWD, astPath(key).c_str(), nullptr, 0);
+    return tu;
+}
+
+static void collectInclusion(CXFile file, CXSourceLocation*, unsigned depth, CXClientData data) {
+    // Depth 0 is the main file, which is covered by the key
+    if (depth == 0) {
+        return;
+    }
+    static_cast<std::vector<CXFile>*>(data)->push_back(file);
+}
+
+bool ASTCache::store(CXTranslationUnit tu, const std::string& key) {
+    if (key.empty()) {
+        return false;
+    }
+
+    std::vector<CXFile> headers;
+    clang_getInclusions(tu, collectInclusion, &headers);
+
+    // Written aside and renamed so concurrent workers never read a partial entry
+    std::string suffix = ".tmp." + std::to_string(getpid());
+    {
+        // Size and mtime as libclang read them during the parse; a stat now
+        // would pin a header edited mid-parse to the stale AST
+        std::ofstream deps(depsPath(key) + suffix);
+        for (CXFile header : headers) {
+            size_t size = 0;
+            if (!clang_getFileContents(tu, header, &size)) {
+                continue;
+            }
+            CXString name = clang_getFileName(header);
+            deps << size << " " << clang_getFileTime(header) << " " << clang_getCString(name) << "\n";
+            clang_disposeString(name);
+        }
+        if (!deps) {
+            unlink((depsPath(key) + suffix).c_str());
+            return false;
+        }
+    }
+
+    // TUs with errors can't be saved; they are simply parsed again next time
+    if (clang_saveTranslationUnit(tu, (astPath(key) + suffix).c_str(), clang_defaultSaveOptions(tu)) !=
+            CXSaveError_None ||
+        rename((depsPath(key) + suffix).c_str(), depsPath(key).c_str()) != 0 ||
+        rename((astPath(key) + suffix).c_str(), astPath(key).c_str()) != 0) {
+        unlink((depsPath(key) + suffix).c_str());
+        unlink((astPath(key) + suffix).c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (stat(astPath(key).c_str(), &st) == 0) {
+        account(st.st_size);
+    }
+    return true;
+}
+
+bool ASTCache::depsUnchanged(const std::string& key) const {
+    std::ifstream deps(depsPath(key));
+    if (!deps) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(deps, line)) {
+        std::istringstream fields(line);
+        long long size, mtime;
+        std::string path;
+        if (!(fields >> size >> mtime) || !std::getline(fields >> std::ws, path)) {
+            return false;
+        }
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || st.st_size != size || st.st_mtime != mtime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ASTCache::remove(const std::string& key) {
+    unlink(astPath(key).c_str());
+    unlink(depsPath(key).c_str());
+}
+
+void ASTCache::account(unsigned long long bytes) {
+    if (maxBytes_ == 0) {
+        return;
+    }
+
+    // Running total shared by all workers; the directory is only scanned
+    // when it is missing or over budget. Entries removed by load are not
+    // subtracted, which can only trigger an early scan.
+    int fd = open((dir_ + "/size").c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return;
+    }
+
+    char buf[32];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    unsigned long long total = 0;
+    if (n > 0) {
+        buf[n] = '\0';
+        total = strtoull(buf, nullptr, 10) + bytes;
+    }
+    if (n <= 0 || total > maxBytes_) {
+        total = evict();
+    }
+
+    std::string text = std::to_string(total) + "\n";
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, text.data(), text.size(), 0) != static_cast<ssize_t>(text.size())) {
+        std::cerr << "Can't update AST cache size: " << dir_ << std::endl;
+    }
+    close(fd);
+}
+
+unsigned long long ASTCache::evict() {
+
+    struct Entry {
+        std::string key;
+        time_t lastUsed;
+        unsigned long long bytes;
+    };
+    std::vector<Entry> entries;
+    unsigned long long total = 0;
+
+    DIR* dir = opendir(dir_.c_str());
+    if (!dir) {
+        return 0;
+    }
+    const std::string suffix = ".ast";
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() <= suffix.size() ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        struct stat st;
+        if (stat((dir_ + "/" + name).c_str(), &st) == 0) {
+            entries.push_back({name.substr(0, name.size() - suffix.size()), st.st_mtime,
+                               static_cast<unsigned long long>(st.st_size)});
+            total += st.st_size;
+        }
+    }
+    closedir(dir);
+
+    if (total <= maxBytes_) {
+        return total;
+    }
+
+    // Down to 90% of the budget so the next scan is many stores away
+    const unsigned long long target = maxBytes_ - maxBytes_ / 10;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.lastUsed < b.lastUsed;
+    });
+    for (const auto& entry : entries) {
+        if (total <= target) {
+            break;
+        }
+        remove(entry.key);
+        total -= entry.bytes;
+    }
+    return total;
+}
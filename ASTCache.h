@@ -0,0 +1,43 @@
+#pragma once
+#include <clang-c/Index.h>
+#include <string>
+#include <vector>
+
+// On-disk cache of parsed translation units.
+//
+// A TU is saved with clang_saveTranslationUnit as <dir>/<key>.ast, where the
+// key hashes the libclang version, the source path and contents, the compiler
+// arguments and the parse options. <key>.deps lists the size and mtime of
+// every header the TU included; a changed header turns the entry into a miss.
+// Hits refresh the entry's mtime. <dir>/size keeps a running total of the
+// entries under a lock, and a store that takes it over budget evicts the
+// least recently used entries.
+class ASTCache {
+public:
+    ASTCache(const std::string& dir, unsigned long long maxBytes);
+
+    // AST files record absolute paths; parsing by absolute path keeps
+    // fresh and cached TUs reporting the same files
+    static std::string absolutePath(const std::string& path);
+
+    // Empty if the source can't be read
+    std::string key(const std::string& sourceFile, const std::vector<std::string>& args,
+                    unsigned parseOptions) const;
+
+    // Cached TU whose inputs are unchanged, nullptr on a miss
+    CXTranslationUnit load(CXIndex index, const std::string& key);
+
+    bool store(CXTranslationUnit tu, const std::string& key);
+
+private:
+    std::string dir_;
+    unsigned long long maxBytes_;
+
+    std::string astPath(const std::string& key) const { return dir_ + "/" + key + ".ast"; }
+    std::string depsPath(const std::string& key) const { return dir_ + "/" + key + ".deps"; }
+    bool depsUnchanged(const std::string& key) const;
+    void remove(const std::string& key);
+    void account(unsigned long long bytes);
+    // Returns the bytes left in the cache
+    unsigned long long evict();
+};
@@ -4,7 +4,7 @@
 #include <clang-c/CXSourceLocation.h>
 #include <iostream>
 
-ASTSerializer::ASTSerializer(const std::string& dbPath) {
+ASTSerializer::ASTSerializer(const std::string& dbPath) : dbPath_(dbPath) {
     if (sqlite3_open(dbPath.c_str(), &db_) != SQLITE_OK) {
         std::cerr << "Can't open database: " << sqlite3_errmsg(db_) << std::endl;
     }
@@ -17,25 +17,63 @@ ASTSerializer::~ASTSerializer() {
 }
 
 bool ASTSerializer::serializeTranslationUnit(CXTranslationUnit tu) {
+    // Built once per TU; calls are attributed to macros by lookup
+    if (symbolsOnly_) {
+        macroExpansions_.clear();
+    } else {
+        macroExpansions_.build(tu, locations_);
+    }
+
     CXCursor cursor = clang_getTranslationUnitCursor(tu);
     traverseAST(cursor);
+
+    // A fresh parse lists implicit instantiations among the TU's top-level
+    // declarations, a TU loaded from an AST file doesn't. Visit the called
+    // ones not seen yet, which may call further instantiations. Those in
+    // system headers, which traverseAST skips, only get a function row so
+    // their edges resolve; their bodies would pull in the library's whole
+    // instantiation graph.
+    for (size_t i = 0; i < calledSpecializations_.size(); i++) {
+        CXCursor callee = calledSpecializations_[i].first;
+        if (declaredSpecializations_.count(calledSpecializations_[i].second) != 0) {
+            continue;
+        }
+        if (clang_Location_isInSystemHeader(clang_getCursorLocation(callee))) {
+            processFunctionDecl(callee);
+        } else {
+            traverseAST(callee);
+        }
+    }
     return true;
 }
 
 void ASTSerializer::traverseAST(CXCursor cursor) {
-    currentContextStack_.clear();
     CXCursorKind kind = clang_getCursorKind(cursor);
-    
-    // Update context stack for function declarations
-    if (kind == CXCursor_FunctionDecl || kind == CXCursor_CXXMethod) {
-        CXString name = clang_getCursorSpelling(cursor);
-        currentContextStack_.push_back(clang_getCString(name));
-        clang_disposeString(name);
+
+    // Library instantiations are only recorded when called, see
+    // serializeTranslationUnit; fresh and cached TUs then store the same rows
+    bool isDeclaration = kind == CXCursor_FunctionDecl || kind == CXCursor_CXXMethod ||
+                         kind == CXCursor_Constructor || kind == CXCursor_Destructor ||
+                         kind == CXCursor_ConversionFunction || kind == CXCursor_ClassDecl ||
+                         kind == CXCursor_StructDecl;
+    if (isDeclaration && clang_Location_isInSystemHeader(clang_getCursorLocation(cursor)) &&
+        !clang_Cursor_isNull(clang_getSpecializedCursorTemplate(cursor))) {
+        return;
+    }
+
+    // Update context stack for function declarations; popped after the body.
+    // Constructors are functions too, e.g. the callees of std::thread spawns.
+    bool isFunction = (kind == CXCursor_FunctionDecl || kind == CXCursor_CXXMethod ||
+                       kind == CXCursor_Constructor);
+    if (isFunction) {
+        currentContextStack_.push_back(getUSR(cursor));
+        currentCallers_.push_back(getQualifiedName(cursor));
     }
 
     switch (kind) {
         case CXCursor_FunctionDecl:
         case CXCursor_CXXMethod:
+        case CXCursor_Constructor:
             processFunctionDecl(cursor);
             break;
         case CXCursor_ClassDecl:
@@ -43,24 +81,31 @@ void ASTSerializer::traverseAST(CXCursor cursor) {
             processClassDecl(cursor);
             break;
         case CXCursor_CallExpr:
-            processCallExpr(cursor, currentContextStack_);
-            break;
         case CXCursor_CXXDynamicCastExpr:
-            processCallExpr(cursor, currentContextStack_);
-            break;
-        case CXCursor_CXXBaseSpecifier:
-            processInheritance(cursor);
+            if (!symbolsOnly_) {
+                processCallExpr(cursor, currentContextStack_);
+            }
             break;
         default:
             break;
     }
 
+    // Nothing below a statement or expression declares symbols
+    if (symbolsOnly_ && (clang_isStatement(kind) || clang_isExpression(kind))) {
+        return;
+    }
+
     clang_visitChildren(cursor, 
         [](CXCursor c, CXCursor parent, CXClientData client_data) {
             auto* self = static_cast<ASTSerializer*>(client_data);
             self->traverseAST(c);
             return CXChildVisit_Continue;
         }, this);
+
+    if (isFunction) {
+        currentContextStack_.pop_back();
+        currentCallers_.pop_back();
+    }
 }
 
 void ASTSerializer::processFunctionDecl(CXCursor cursor) {
@@ -71,10 +116,8 @@ void ASTSerializer::processFunctionDecl(CXCursor cursor) {
     info.name = clang_getCString(name);
     clang_disposeString(name);
 
-    // Get qualified name
-    CXString qualifiedName = clang_getCursorDisplayName(cursor);
-    info.qualifiedName = clang_getCString(qualifiedName);
-    clang_disposeString(qualifiedName);
+    info.qualifiedName = getQualifiedName(cursor);
+    info.usr = getUSR(cursor);
 
     // Get return type
     CXType returnType = clang_getCursorResultType(cursor);
@@ -89,9 +132,14 @@ void ASTSerializer::processFunctionDecl(CXCursor cursor) {
     }
 
     // Get location
-    info.filePath = getCursorLocation(cursor);
-    CXSourceLocation loc = clang_getCursorLocation(cursor);
-    clang_getExpansionLocation(loc, nullptr, &info.line, &info.column, nullptr);
+    LocationCache::Location loc = locations_.decode(cursor);
+    info.fileId = loc.fileId;
+    info.line = loc.line;
+    info.column = loc.column;
+
+    if (!clang_Cursor_isNull(clang_getSpecializedCursorTemplate(cursor))) {
+        declaredSpecializations_.insert(info.usr);
+    }
 
     functions_.push_back(info);
 }
@@ -104,15 +152,17 @@ void ASTSerializer::processClassDecl(CXCursor cursor) {
     info.name = clang_getCString(name);
     clang_disposeString(name);
 
-    // Get qualified name
-    CXString qualifiedName = clang_getCursorDisplayName(cursor);
-    info.qualifiedName = clang_getCString(qualifiedName);
-    clang_disposeString(qualifiedName);
+    // a::Node and b::Node are different classes
+    info.qualifiedName = getQualifiedName(cursor);
+    info.usr = getUSR(cursor);
 
     // Get location
-    info.filePath = getCursorLocation(cursor);
-    CXSourceLocation loc = clang_getCursorLocation(cursor);
-    clang_getExpansionLocation(loc, nullptr, &info.line, &info.column, nullptr);
+    LocationCache::Location loc = locations_.decode(cursor);
+    info.fileId = loc.fileId;
+    info.line = loc.line;
+    info.column = loc.column;
+
+    processInheritance(cursor, info);
 
     classes_.push_back(info);
 }
@@ -122,7 +172,8 @@ void ASTSerializer::processCallExpr(CXCursor cursor, const std::vector<std::stri
     
     // Get caller (current function)
     if (!contextStack.empty()) {
-        call.caller = contextStack.back();
+        call.caller = currentCallers_.back();
+        call.callerUsr = contextStack.back();
     }
 
     // Get callee
@@ -130,32 +181,34 @@ void ASTSerializer::processCallExpr(CXCursor cursor, const std::vector<std::stri
     if (clang_isInvalid(clang_getCursorKind(referenced))) {
         return;
     }
-    CXString calleeName = clang_getCursorSpelling(referenced);
-    call.callee = clang_getCString(calleeName);
-    clang_disposeString(calleeName);
+    call.callee = getQualifiedName(referenced);
 
     // Get call location
-    call.filePath = getCursorLocation(cursor);
-    CXSourceLocation loc = clang_getCursorLocation(cursor);
-    clang_getExpansionLocation(loc, nullptr, &call.line, &call.column, nullptr);
-
-    // Check for special call types
-    call.isVirtualCall = clang_CXXMethod_isVirtual(referenced);
-    call.isTemplateInstantiation = (clang_getTemplateCursorKind(cursor) == CXCursor_FunctionTemplate);
+    LocationCache::Location loc = locations_.decode(cursor);
+    call.fileId = loc.fileId;
+    call.line = loc.line;
+    call.column = loc.column;
+
+    // Check for special call types; the report pass may have classified it
+    CalleeClassifier::Callee callee = classifier_.classify(cursor, referenced);
+    unsigned kinds = callee.kinds;
+    call.calleeUsr = *callee.usr;
+    call.isVirtualCall = (kinds & CalleeClassifier::VirtualDispatch) != 0;
+    call.isAsyncSpawn = (kinds & CalleeClassifier::AsyncSpawn) != 0;
+    call.isStdFunctionCall = (kinds & CalleeClassifier::StdFunctionCall) != 0;
+    call.isOperatorCall = (kinds & CalleeClassifier::Operator) != 0;
+    if (!processTemplateCall(referenced, call)) {
+        return;
+    }
     call.isExceptionPath = (clang_getCursorKind(cursor) == CXCursor_CXXThrowExpr || 
                           clang_getCursorKind(cursor) == CXCursor_CXXCatchStmt);
     call.isDynamicCast = (clang_getCursorKind(cursor) == CXCursor_CXXDynamicCastExpr);
 
     // Check for macro expansion
-    call.isMacroExpansion = (clang_getCursorKind(cursor) == CXCursor_MacroExpansion);
-    if (call.isMacroExpansion) {
-        CXCursor defCursor = clang_getCursorDefinition(referenced);
-        if (!clang_isInvalid(clang_getCursorKind(defCursor))) {
-            call.macroDefinitionFile = getCursorLocation(defCursor);
-            CXSourceLocation defLoc = clang_getCursorLocation(defCursor);
-            clang_getExpansionLocation(defLoc, nullptr, &call.macroDefinitionLine, nullptr, nullptr);
-        }
-    }
+    const MacroExpansionIndex::Expansion* expansion = macroExpansions_.find(loc.fileId, loc.offset);
+    call.isMacroExpansion = (expansion != nullptr);
+    call.macroDefinitionFileId = expansion ? expansion->definitionFileId : 0;
+    call.macroDefinitionLine = expansion ? expansion->definitionLine : 0;
 
     // Store context stack
     call.contextStack = contextStack;
@@ -164,39 +217,95 @@ void ASTSerializer::processCallExpr(CXCursor cursor, const std::vector<std::stri
     calls_.push_back(call);
 }
 
-void ASTSerializer::processInheritance(CXCursor cursor) {
-    CXCursor derivedCursor = clang_getCursorSemanticParent(cursor);
-    CXCursor baseCursor = clang_getTypeDeclaration(clang_getCursorType(cursor));
+bool ASTSerializer::processTemplateCall(CXCursor referenced, CallInfo& call) {
+    call.templateId = 0;
+    call.specializationId = 0;
 
-    // Get derived class name
-    CXString derivedName = clang_getCursorDisplayName(derivedCursor);
-    std::string derived = clang_getCString(derivedName);
-    clang_disposeString(derivedName);
+    // Non-null only for instantiations and specializations
+    CXCursor primary = clang_getSpecializedCursorTemplate(referenced);
+    call.isTemplateInstantiation = !clang_Cursor_isNull(primary);
+    if (!call.isTemplateInstantiation) {
+        return true;
+    }
+    calledSpecializations_.emplace_back(referenced, call.calleeUsr);
 
-    // Get base class name
-    CXString baseName = clang_getCursorDisplayName(baseCursor);
-    std::string base = clang_getCString(baseName);
-    clang_disposeString(baseName);
+    std::string templateUsr = getUSR(primary);
 
-    // Store inheritance relationship
-    for (auto& cls : classes_) {
-        if (cls.qualifiedName == derived) {
-            cls.baseClasses.push_back(base);
-            break;
-        }
+    auto it = templateIds_.find(templateUsr);
+    if (it == templateIds_.end()) {
+        TemplateInfo info;
+        info.usr = templateUsr;
+        CXString name = clang_getCursorSpelling(primary);
+        info.name = clang_getCString(name);
+        clang_disposeString(name);
+        LocationCache::Location loc = locations_.decode(primary);
+        info.fileId = loc.fileId;
+        info.line = loc.line;
+        templates_.push_back(info);
+        it = templateIds_.emplace(templateUsr, static_cast<unsigned>(templates_.size())).first;
     }
+    call.templateId = it->second;
+
+    if (collapseTemplates_) {
+        // Keep the first edge from each caller into the template. Its callee
+        // stays the specialization called there, which has a functions row;
+        // template_id identifies the collapsed edge.
+        std::string edgeKey = call.callerUsr + '\0' + std::to_string(call.templateId);
+        return collapsedEdges_.insert(edgeKey).second;
+    }
+
+    std::string signature = getSpecializationSignature(referenced);
+    std::string key = std::to_string(call.templateId) + '\0' + signature;
+    auto specIt = specializationIds_.find(key);
+    if (specIt == specializationIds_.end()) {
+        specializations_.push_back({call.templateId, signature});
+        specIt = specializationIds_.emplace(key, static_cast<unsigned>(specializations_.size())).first;
+    }
+    call.specializationId = specIt->second;
+    return true;
 }
 
-std::string ASTSerializer::getCursorLocation(CXCursor cursor) {
-    CXSourceLocation loc = clang_getCursorLocation(cursor);
-    CXFile file;
-    unsigned line, column, offset;
-    clang_getExpansionLocation(loc, &file, &line, &column, &offset);
+void ASTSerializer::processInheritance(CXCursor cursor, ClassInfo& info) {
+    // Base specifiers are direct children of the class declaration
+    clang_visitChildren(cursor,
+        [](CXCursor c, CXCursor parent, CXClientData client_data) {
+            if (clang_getCursorKind(c) == CXCursor_CXXBaseSpecifier) {
+                auto* bases = static_cast<std::vector<std::string>*>(client_data);
+                CXCursor baseCursor = clang_getTypeDeclaration(clang_getCursorType(c));
+                bases->push_back(getUSR(baseCursor));
+            }
+            return CXChildVisit_Continue;
+        }, &info.baseClasses);
+}
 
-    CXString fileName = clang_getFileName(file);
-    std::string result = clang_getCString(fileName);
-    clang_disposeString(fileName);
+std::string ASTSerializer::getQualifiedName(CXCursor cursor) {
+    // Display names of the enclosing namespaces, classes and functions, so
+    // A::run() and B::run() stay apart
+    CXString displayName = clang_getCursorDisplayName(cursor);
+    std::string result = clang_getCString(displayName);
+    clang_disposeString(displayName);
+
+    for (CXCursor parent = clang_getCursorSemanticParent(cursor);
+         !clang_isInvalid(clang_getCursorKind(parent)) &&
+         clang_getCursorKind(parent) != CXCursor_TranslationUnit;
+         parent = clang_getCursorSemanticParent(parent)) {
+        CXString scope = clang_getCursorDisplayName(parent);
+        std::string part = clang_getCString(scope);
+        clang_disposeString(scope);
+        if (part.empty()) {
+            part = clang_getCursorKind(parent) == CXCursor_Namespace ? "(anonymous namespace)"
+                                                                       : "(anonymous)";
+        }
+        result = part + "::" + result;
+    }
+    return result;
+}
 
+std::string ASTSerializer::getUSR(CXCursor cursor) {
+    CXString usr = clang_getCursorUSR(cursor);
+    const char* data = clang_getCString(usr);
+    std::string result = data ? data : "";
+    clang_disposeString(usr);
     return result;
 }
 
@@ -231,40 +340,56 @@ std::string ASTSerializer::getTypeSpelling(CXType type) {
     return result;
 }
 
+std::string ASTSerializer::getSpecializationSignature(CXCursor cursor) {
+    // Enclosing class specialization, e.g. std::vector<int>
+    std::string result;
+    CXCursor parent = clang_getCursorSemanticParent(cursor);
+    CXCursorKind parentKind = clang_getCursorKind(parent);
+    if (parentKind == CXCursor_ClassDecl || parentKind == CXCursor_StructDecl) {
+        result = getTypeSpelling(clang_getCursorType(parent)) + "::";
+    }
+
+    CXString name = clang_getCursorSpelling(cursor);
+    result += clang_getCString(name);
+    clang_disposeString(name);
+
+    // Function template arguments, if any
+    int numArgs = clang_Cursor_getNumTemplateArguments(cursor);
+    if (numArgs > 0) {
+        result += "<";
+        for (int i = 0; i < numArgs; i++) {
+            if (i > 0) result += ", ";
+            result += getTypeSpelling(clang_Cursor_getTemplateArgumentType(cursor, i));
+        }
+        result += ">";
+    }
+
+    return result + " " + getTypeSpelling(clang_getCursorType(cursor));
+}
+
 bool ASTSerializer::saveToDatabase() {
     try {
-        ProjectDB db("callgraph.db");
+        ProjectDB db(dbPath_);
         if (!db.initializeSchema()) {
             std::cerr << "Failed to initialize database schema" << std::endl;
             return false;
         }
 
-        // Store functions
-        for (const auto& func : functions_) {
-            if (!db.storeFunction(func)) {
-                std::cerr << "Failed to store function: " << func.qualifiedName << std::endl;
-                return false;
-            }
+        // One transaction per TU: a failed or crashed TU leaves no partial rows
+        if (!db.beginTransaction()) {
+            std::cerr << "Failed to begin transaction" << std::endl;
+            return false;
         }
-
-        // Store classes
-        for (const auto& cls : classes_) {
-            if (!db.storeClass(cls)) {
-                std::cerr << "Failed to store class: " << cls.qualifiedName << std::endl;
-                return false;
-            }
+        if (!storeAll(db)) {
+            db.rollbackTransaction();
+            return false;
         }
-
-        // Store calls
-        for (const auto& call : calls_) {
-            if (!db.storeCallRelation(call)) {
-                std::cerr << "Failed to store call relation: " 
-                         << call.caller << " -> " << call.callee << std::endl;
-                return false;
-            }
+        if (!db.commitTransaction()) {
+            std::cerr << "Failed to commit call graph" << std::endl;
+            return false;
         }
 
-        std::cout << "Successfully stored " << functions_.size() << " functions, "
+        std::cerr << "Successfully stored " << functions_.size() << " functions, "
                   << classes_.size() << " classes, and " << calls_.size() 
                   << " call relations in database" << std::endl;
         return true;
@@ -273,3 +398,53 @@ bool ASTSerializer::saveToDatabase() {
         return false;
     }
 }
+
+bool ASTSerializer::storeAll(ProjectDB& db) {
+    // Store file paths once; rows refer to them by id
+    if (!db.storeFiles(locations_.paths())) {
+        std::cerr << "Failed to store file paths" << std::endl;
+        return false;
+    }
+
+    if (!db.storeTemplates(templates_, specializations_)) {
+        std::cerr << "Failed to store templates" << std::endl;
+        return false;
+    }
+
+    // Store functions
+    for (const auto& func : functions_) {
+        if (!db.storeFunction(func)) {
+            std::cerr << "Failed to store function: " << func.qualifiedName << std::endl;
+            return false;
+        }
+    }
+
+    // Store classes
+    for (const auto& cls : classes_) {
+        if (!db.storeClass(cls)) {
+            std::cerr << "Failed to store class: " << cls.qualifiedName << std::endl;
+            return false;
+        }
+    }
+
+    // Store calls
+    size_t unresolvedTemplateEdges = 0;
+    for (const auto& call : calls_) {
+        bool stored = false;
+        if (!db.storeCallRelation(call, &stored)) {
+            std::cerr << "Failed to store call relation: " 
+                     << call.caller << " -> " << call.callee << std::endl;
+            return false;
+        }
+        if (!stored && collapseTemplates_ && call.templateId != 0) {
+            unresolvedTemplateEdges++;
+        }
+    }
+    // Each (caller, template) pair should leave exactly one calls row
+    if (unresolvedTemplateEdges > 0) {
+        std::cerr << "Warning: " << unresolvedTemplateEdges
+                  << " collapsed template edges did not resolve to indexed functions" << std::endl;
+    }
+
+    return true;
+}
@@ -3,17 +3,25 @@
 #include <clang-c/CXString.h>
 #include <clang-c/CXSourceLocation.h>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <sqlite3.h>
+#include "CalleeClassifier.h"
+#include "LocationCache.h"
+#include "MacroExpansionIndex.h"
+
+class ProjectDB;
 
 class ASTSerializer {
 public:
     struct FunctionInfo {
         std::string name;
-        std::string qualifiedName;
+        std::string qualifiedName;   // enclosing scopes + display name, e.g. "ns::A::run(int)"
+        std::string usr;             // identity across TUs and databases
         std::string returnType;
         std::vector<std::string> parameters;
-        std::string filePath;
+        unsigned fileId;
         unsigned line;
         unsigned column;
     };
@@ -21,26 +29,48 @@ public:
     struct ClassInfo {
         std::string name;
         std::string qualifiedName;
-        std::vector<std::string> baseClasses;
-        std::string filePath;
+        std::string usr;
+        std::vector<std::string> baseClasses;   // USRs of the direct bases
+        unsigned fileId;
         unsigned line;
         unsigned column;
     };
 
+    // Primary template, stored once per USR
+    struct TemplateInfo {
+        std::string usr;
+        std::string name;
+        unsigned fileId;
+        unsigned line;
+    };
+
+    // One distinct set of template arguments of a primary template
+    struct SpecializationInfo {
+        unsigned templateId;
+        std::string signature;
+    };
+
     struct CallInfo {
         std::string caller;
         std::string callee;
-        std::string filePath;
+        std::string callerUsr;
+        std::string calleeUsr;
+        unsigned fileId;
         unsigned line;
         unsigned column;
         bool isMacroExpansion;
-        std::string macroDefinitionFile;
+        unsigned macroDefinitionFileId;
         unsigned macroDefinitionLine;
         bool isVirtualCall;
         bool isTemplateInstantiation;
+        unsigned templateId;        // 1-based index into templates(), 0 if none
+        unsigned specializationId;  // 1-based index into specializations(), 0 if none
         bool isExceptionPath;
         bool isDynamicCast;
-        std::vector<std::string> contextStack;
+        bool isAsyncSpawn;
+        bool isStdFunctionCall;
+        bool isOperatorCall;
+        std::vector<std::string> contextStack;   // USRs of the enclosing functions
     };
 
     ASTSerializer(const std::string& dbPath);
@@ -49,19 +79,54 @@ public:
     bool serializeTranslationUnit(CXTranslationUnit tu);
     bool saveToDatabase();
 
+    // Declaration-only indexing: collect functions, classes and inheritance
+    // but skip call expressions. Meant for TUs parsed with
+    // CXTranslationUnit_SkipFunctionBodies.
+    void setSymbolsOnly(bool symbolsOnly) { symbolsOnly_ = symbolsOnly; }
+
+    // Keep one edge per (caller, primary template): the first specialization
+    // called is the callee and calls.template_id the collapse key.
+    void setCollapseTemplates(bool collapse) { collapseTemplates_ = collapse; }
+
+    const std::vector<TemplateInfo>& templates() const { return templates_; }
+    const std::vector<SpecializationInfo>& specializations() const { return specializations_; }
+
+    // Shared with other passes over the same TU
+    CalleeClassifier& calleeClassifier() { return classifier_; }
+
 private:
     sqlite3* db_;
+    std::string dbPath_;
+    bool symbolsOnly_ = false;
+    bool collapseTemplates_ = false;
     std::vector<FunctionInfo> functions_;
     std::vector<ClassInfo> classes_;
     std::vector<CallInfo> calls_;
+    // Enclosing functions: USRs, and the qualified name of the innermost
     std::vector<std::string> currentContextStack_;
+    std::vector<std::string> currentCallers_;
+    LocationCache locations_;
+    MacroExpansionIndex macroExpansions_;
+    CalleeClassifier classifier_;
+    std::vector<TemplateInfo> templates_;
+    std::vector<SpecializationInfo> specializations_;
+    std::unordered_map<std::string, unsigned> templateIds_;
+    std::unordered_map<std::string, unsigned> specializationIds_;
+    std::unordered_set<std::string> collapsedEdges_;
+    // USRs of specializations with a function row, and the called ones
+    std::unordered_set<std::string> declaredSpecializations_;
+    std::vector<std::pair<CXCursor, std::string>> calledSpecializations_;
 
+    bool storeAll(ProjectDB& db);
     void traverseAST(CXCursor cursor);
     void processFunctionDecl(CXCursor cursor);
     void processClassDecl(CXCursor cursor);
     void processCallExpr(CXCursor cursor, const std::vector<std::string>& contextStack = {});
-    void processInheritance(CXCursor cursor);
+    void processInheritance(CXCursor cursor, ClassInfo& info);
+    bool processTemplateCall(CXCursor referenced, CallInfo& call);
 
-    static std::string getCursorLocation(CXCursor cursor);
+    static std::string getQualifiedName(CXCursor cursor);
+    static std::string getUSR(CXCursor cursor);
     static std::string getTypeSpelling(CXType type);
+    static std::string getSpecializationSignature(CXCursor cursor);
 };
@@ -0,0 +1,194 @@
+#include "CallGraph.h"
+#include <algorithm>
+#include <iostream>
+
+bool CallGraph::load(const std::string& dbPath) {
+    sqlite3* db;
+    if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return false;
+    }
+
+    bool ok = loadFiles(db) && loadFunctions(db) && loadCalls(db);
+    if (!ok) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_close(db);
+    return ok;
+}
+
+bool CallGraph::loadFiles(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id, path FROM files", -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    files_.assign(1, "");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        size_t id = sqlite3_column_int64(stmt, 0);
+        if (id >= files_.size()) {
+            files_.resize(id + 1);
+        }
+        files_[id] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+bool CallGraph::loadFunctions(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT id, qualified_name, usr, file_id, line FROM functions ORDER BY id";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        size_t id = sqlite3_column_int64(stmt, 0);
+        std::string qualifiedName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const char* usr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        // USRs and names can't collide: every USR starts with "c:"
+        std::string key = usr ? usr : qualifiedName;
+
+        auto it = nodeByKey_.find(key);
+        if (it == nodeByKey_.end()) {
+            it = nodeByKey_.emplace(key, static_cast<uint32_t>(names_.size())).first;
+            names_.push_back(qualifiedName);
+            functionIds_.push_back(static_cast<int64_t>(id));
+            uint32_t fileId = static_cast<uint32_t>(sqlite3_column_int64(stmt, 3));
+            declarations_.push_back({fileId < files_.size() ? fileId : 0,
+                                     static_cast<uint32_t>(sqlite3_column_int(stmt, 4))});
+        }
+        if (id >= functionNodes_.size()) {
+            functionNodes_.resize(id + 1, kNone);
+        }
+        functionNodes_[id] = it->second;
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+bool CallGraph::loadCalls(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT caller_id, callee_id, call_file_id, call_line FROM calls";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    struct RawEdge {
+        uint32_t caller;
+        uint32_t callee;
+        CallSite site;
+    };
+    std::vector<RawEdge> raw;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        uint32_t caller = nodeForFunction(sqlite3_column_int64(stmt, 0));
+        uint32_t callee = nodeForFunction(sqlite3_column_int64(stmt, 1));
+        if (caller == kNone || callee == kNone) {
+            continue;
+        }
+        uint32_t fileId = static_cast<uint32_t>(sqlite3_column_int64(stmt, 2));
+        raw.push_back({caller, callee, {fileId < files_.size() ? fileId : 0,
+                                        static_cast<uint32_t>(sqlite3_column_int(stmt, 3))}});
+    }
+    sqlite3_finalize(stmt);
+
+    // Sorted by (caller, callee, site) so the first of parallel calls is kept
+    std::sort(raw.begin(), raw.end(), [](const RawEdge& a, const RawEdge& b) {
+        if (a.caller != b.caller) return a.caller < b.caller;
+        if (a.callee != b.callee) return a.callee < b.callee;
+        if (a.site.fileId != b.site.fileId) return a.site.fileId < b.site.fileId;
+        return a.site.line < b.site.line;
+    });
+
+    size_t nodes = names_.size();
+    outOffsets_.assign(nodes + 1, 0);
+    inOffsets_.assign(nodes + 1, 0);
+    edgeCallees_.clear();
+    sites_.clear();
+    for (size_t i = 0; i < raw.size(); i++) {
+        if (i > 0 && raw[i].caller == raw[i - 1].caller && raw[i].callee == raw[i - 1].callee) {
+            continue;
+        }
+        outOffsets_[raw[i].caller + 1]++;
+        inOffsets_[raw[i].callee + 1]++;
+        edgeCallees_.push_back(raw[i].callee);
+        sites_.push_back(raw[i].site);
+    }
+    for (size_t n = 0; n < nodes; n++) {
+        outOffsets_[n + 1] += outOffsets_[n];
+        inOffsets_[n + 1] += inOffsets_[n];
+    }
+
+    // Out-edges are already grouped by caller; scatter them by callee
+    inCallers_.assign(edgeCallees_.size(), 0);
+    inEdges_.assign(edgeCallees_.size(), 0);
+    std::vector<uint32_t> fill(inOffsets_.begin(), inOffsets_.end() - 1);
+    for (uint32_t caller = 0; caller < nodes; caller++) {
+        for (uint32_t e = outBegin(caller); e < outEnd(caller); e++) {
+            uint32_t slot = fill[edgeCallees_[e]]++;
+            inCallers_[slot] = caller;
+            inEdges_[slot] = e;
+        }
+    }
+    return true;
+}
+
+uint32_t CallGraph::findNode(const std::string& symbol, std::vector<uint32_t>* candidates) const {
+    // Distinct functions can share a qualified name (static functions,
+    // functions in anonymous namespaces of different files)
+    std::vector<uint32_t> matches;
+    for (uint32_t node = 0; node < names_.size(); node++) {
+        if (names_[node] == symbol) {
+            matches.push_back(node);
+        }
+    }
+
+    // "ns::f" matches "ns::f(int)", "f" matches "ns::f(int)" and "f(int)"
+    bool exact = !matches.empty();
+    for (uint32_t node = 0; !exact && node < names_.size(); node++) {
+        const std::string& name = names_[node];
+        size_t end = parameterListStart(name);
+        if (end < symbol.size() || name.compare(end - symbol.size(), symbol.size(), symbol) != 0) {
+            continue;
+        }
+        size_t begin = end - symbol.size();
+        if (begin == 0 || (begin >= 2 && name.compare(begin - 2, 2, "::") == 0)) {
+            matches.push_back(node);
+        }
+    }
+
+    if (matches.size() == 1) {
+        return matches[0];
+    }
+    if (candidates) {
+        *candidates = matches;
+    }
+    return kNone;
+}
+
+size_t CallGraph::parameterListStart(const std::string& name) {
+    // The parameter list is the parenthesized group that closes last: scopes
+    // such as "(anonymous namespace)::" hold parentheses too, and so does the
+    // name in "A::operator()(int)"
+    size_t close = name.rfind(')');
+    if (close == std::string::npos) {
+        return name.size();
+    }
+    int depth = 0;
+    for (size_t i = close + 1; i-- > 0;) {
+        if (name[i] == ')') {
+            depth++;
+        } else if (name[i] == '(' && --depth == 0) {
+            return i;
+        }
+    }
+    return name.size();
+}
+
+uint32_t CallGraph::findEdge(uint32_t caller, uint32_t callee) const {
+    auto begin = edgeCallees_.begin() + outBegin(caller);
+    auto end = edgeCallees_.begin() + outEnd(caller);
+    auto it = std::lower_bound(begin, end, callee);
+    return it != end && *it == callee ? static_cast<uint32_t>(it - edgeCallees_.begin()) : kNone;
+}
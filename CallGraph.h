@@ -0,0 +1,85 @@
+#pragma once
+#include <sqlite3.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Read-only in-memory call graph loaded from a callgraph database.
+//
+// Every TU stores its own copy of the functions it sees, so nodes are the
+// distinct USRs rather than functions rows; rows migrated from schema v2 have
+// no USR and fall back to their qualified name. Parallel calls between
+// the same pair of functions collapse into one edge that keeps the first call
+// site. Both directions are held in CSR form: the out-edges of node n are
+// edges [outBegin(n), outEnd(n)) sorted by callee; in-edges are listed per
+// callee and refer back to those edge indexes.
+class CallGraph {
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct CallSite {
+        uint32_t fileId;  // index into filePath(), 0 if unknown
+        uint32_t line;
+    };
+
+    // Tells same-named functions apart, e.g. static functions of two files
+    const CallSite& declaration(uint32_t node) const { return declarations_[node]; }
+
+    bool load(const std::string& dbPath);
+
+    size_t nodeCount() const { return names_.size(); }
+    size_t edgeCount() const { return edgeCallees_.size(); }
+    const std::string& name(uint32_t node) const { return names_[node]; }
+
+    // Node of a functions row id, kNone if the id is unknown
+    uint32_t nodeForFunction(int64_t functionId) const {
+        return functionId >= 0 && static_cast<size_t>(functionId) < functionNodes_.size()
+                   ? functionNodes_[functionId] : kNone;
+    }
+
+    // Lowest functions row id of the node, the one calls rows refer to
+    int64_t functionId(uint32_t node) const { return functionIds_[node]; }
+
+    // Unique exact qualified name ("ns::A::run(int)"), otherwise a unique match
+    // on a trailing part of the name without its parameter list ("A::run",
+    // "run"). Ambiguous matches fill candidates.
+    uint32_t findNode(const std::string& symbol, std::vector<uint32_t>* candidates = nullptr) const;
+
+    // Offset of the parameter list in a qualified name, its size if none
+    static size_t parameterListStart(const std::string& name);
+
+    uint32_t outBegin(uint32_t node) const { return outOffsets_[node]; }
+    uint32_t outEnd(uint32_t node) const { return outOffsets_[node + 1]; }
+    uint32_t callee(uint32_t edge) const { return edgeCallees_[edge]; }
+    const CallSite& site(uint32_t edge) const { return sites_[edge]; }
+
+    uint32_t inBegin(uint32_t node) const { return inOffsets_[node]; }
+    uint32_t inEnd(uint32_t node) const { return inOffsets_[node + 1]; }
+    uint32_t inCaller(uint32_t index) const { return inCallers_[index]; }
+    uint32_t inEdge(uint32_t index) const { return inEdges_[index]; }
+
+    // Edge from caller to callee, kNone if there is none
+    uint32_t findEdge(uint32_t caller, uint32_t callee) const;
+
+    const std::string& filePath(uint32_t fileId) const { return files_[fileId]; }
+
+private:
+    std::vector<std::string> names_;
+    std::vector<CallSite> declarations_;
+    std::unordered_map<std::string, uint32_t> nodeByKey_;
+    std::vector<uint32_t> functionNodes_;
+    std::vector<int64_t> functionIds_;
+    std::vector<std::string> files_;
+
+    std::vector<uint32_t> outOffsets_;
+    std::vector<uint32_t> edgeCallees_;
+    std::vector<CallSite> sites_;
+    std::vector<uint32_t> inOffsets_;
+    std::vector<uint32_t> inCallers_;
+    std::vector<uint32_t> inEdges_;
+
+    bool loadFiles(sqlite3* db);
+    bool loadFunctions(sqlite3* db);
+    bool loadCalls(sqlite3* db);
+};
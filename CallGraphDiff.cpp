@@ -0,0 +1,214 @@
+#include "CallGraphDiff.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include "ProjectDB.h"
+
+static uint64_t hashName(const char* name) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *name; name++) {
+        h ^= static_cast<unsigned char>(*name);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t hashSite(uint64_t file, uint64_t line, uint64_t column) {
+    uint64_t h = file;
+    for (uint64_t value : {line, column}) {
+        h ^= value;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static std::string flagNames(uint32_t flags) {
+    static const std::pair<uint32_t, const char*> names[] = {
+        {ProjectDB::CallVirtual, "virtual"},
+        {ProjectDB::CallTemplateInstantiation, "template"},
+        {ProjectDB::CallExceptionPath, "exception"},
+        {ProjectDB::CallMacroExpansion, "macro"},
+        {ProjectDB::CallDynamicCast, "dynamic_cast"},
+        {ProjectDB::CallAsyncSpawn, "async"},
+        {ProjectDB::CallStdFunction, "std_function"},
+        {ProjectDB::CallOperator, "operator"}
+    };
+    std::string result;
+    for (const auto& name : names) {
+        if (flags & name.first) {
+            result += result.empty() ? "" : "|";
+            result += name.second;
+        }
+    }
+    return result.empty() ? "none" : result;
+}
+
+bool CallGraphDiff::load(const std::string& oldPath, const std::string& newPath) {
+    bool oldOk = false;
+    std::thread oldLoader([&] { oldOk = loadSnapshot(oldPath, old_); });
+    bool newOk = loadSnapshot(newPath, new_);
+    oldLoader.join();
+    return oldOk && newOk;
+}
+
+bool CallGraphDiff::loadSnapshot(const std::string& path, Snapshot& snapshot) {
+    sqlite3* db;
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return false;
+    }
+
+    // functions ids are dense, so a vector maps them to hashes
+    std::vector<uint64_t> hashes;
+    sqlite3_stmt* stmt;
+    bool ok = sqlite3_prepare_v2(db, "SELECT id, qualified_name, usr FROM functions", -1, &stmt, nullptr) ==
+              SQLITE_OK;
+    if (ok) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            size_t id = sqlite3_column_int64(stmt, 0);
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            if (!name) {
+                continue;
+            }
+            // The USR tells apart functions that share a qualified name
+            const char* usr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            uint64_t hash = hashName(usr ? usr : name);
+            if (id >= hashes.size()) {
+                hashes.resize(id + 1, 0);
+            }
+            hashes[id] = hash;
+            snapshot.names.try_emplace(hash, name);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    // File ids differ between databases, so call sites are keyed by a hash
+    // of the path; 0 stands for calls without a file
+    std::vector<uint64_t> fileHashes;
+    ok = ok && sqlite3_prepare_v2(db, "SELECT id, path FROM files", -1, &stmt, nullptr) == SQLITE_OK;
+    if (ok) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            size_t id = sqlite3_column_int64(stmt, 0);
+            if (id >= fileHashes.size()) {
+                fileHashes.resize(id + 1, 0);
+            }
+            fileHashes[id] = hashName(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    ok = ok && sqlite3_prepare_v2(db,
+                                  "SELECT caller_id, callee_id, flags, call_file_id, call_line, call_column FROM calls",
+                                  -1, &stmt, nullptr) == SQLITE_OK;
+    if (ok) {
+        struct Call {
+            uint64_t caller;
+            uint64_t callee;
+            uint64_t site;
+            uint32_t flags;
+        };
+        std::vector<Call> calls;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            size_t caller = sqlite3_column_int64(stmt, 0);
+            size_t callee = sqlite3_column_int64(stmt, 1);
+            // 0 marks ids without a functions row
+            if (caller >= hashes.size() || callee >= hashes.size() || hashes[caller] == 0 ||
+                hashes[callee] == 0) {
+                continue;
+            }
+            size_t file = sqlite3_column_int64(stmt, 3);
+            uint64_t site = hashSite(file < fileHashes.size() ? fileHashes[file] : 0,
+                                     sqlite3_column_int64(stmt, 4), sqlite3_column_int64(stmt, 5));
+            calls.push_back({hashes[caller], hashes[callee], site,
+                             static_cast<uint32_t>(sqlite3_column_int(stmt, 2))});
+        }
+        sqlite3_finalize(stmt);
+
+        // Parallel calls between the same functions become one edge; a call
+        // site stored more than once (a header in several TUs) counts once
+        std::sort(calls.begin(), calls.end(), [](const Call& a, const Call& b) {
+            if (a.caller != b.caller) {
+                return a.caller < b.caller;
+            }
+            return a.callee != b.callee ? a.callee < b.callee : a.site < b.site;
+        });
+        std::vector<Edge>& edges = snapshot.edges;
+        for (size_t i = 0; i < calls.size(); i++) {
+            const Call& call = calls[i];
+            if (!edges.empty() && edges.back().caller == call.caller && edges.back().callee == call.callee) {
+                edges.back().flags |= call.flags;
+                if (call.site != calls[i - 1].site) {
+                    edges.back().calls++;
+                }
+            } else {
+                edges.push_back({call.caller, call.callee, call.flags, 1});
+            }
+        }
+    }
+
+    if (!ok) {
+        std::cerr << "SQL error in " << path << ": " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_close(db);
+    return ok;
+}
+
+std::string CallGraphDiff::name(const Snapshot& snapshot, uint64_t hash) {
+    auto it = snapshot.names.find(hash);
+    if (it != snapshot.names.end()) {
+        return it->second;
+    }
+    char text[20];
+    snprintf(text, sizeof(text), "#%016" PRIx64, hash);
+    return text;
+}
+
+CallGraphDiff::Counts CallGraphDiff::write(std::ostream& out) const {
+    Counts counts;
+    const std::vector<Edge>& before = old_.edges;
+    const std::vector<Edge>& after = new_.edges;
+    size_t i = 0, j = 0;
+    while (i < before.size() || j < after.size()) {
+        bool removed = j == after.size() ||
+                       (i < before.size() && (before[i].caller != after[j].caller
+                                                  ? before[i].caller < after[j].caller
+                                                  : before[i].callee < after[j].callee));
+        if (removed) {
+            out << "- " << name(old_, before[i].caller) << " -> " << name(old_, before[i].callee) << '\n';
+            counts.removed++;
+            i++;
+            continue;
+        }
+
+        bool added = i == before.size() || before[i].caller != after[j].caller ||
+                     before[i].callee != after[j].callee;
+        if (added) {
+            out << "+ " << name(new_, after[j].caller) << " -> " << name(new_, after[j].callee) << '\n';
+            counts.added++;
+            j++;
+            continue;
+        }
+
+        const Edge& a = before[i];
+        const Edge& b = after[j];
+        if (a.flags != b.flags || a.calls != b.calls) {
+            out << "~ " << name(new_, b.caller) << " -> " << name(new_, b.callee);
+            if (a.flags != b.flags) {
+                out << "  [flags " << flagNames(a.flags) << " -> " << flagNames(b.flags) << "]";
+            }
+            if (a.calls != b.calls) {
+                out << "  [calls " << a.calls << " -> " << b.calls << "]";
+            }
+            out << '\n';
+            counts.changed++;
+        }
+        i++;
+        j++;
+    }
+    out.flush();
+    return counts;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compares the call edges of two callgraph databases.
+//
+// Functions are keyed by a 64-bit hash of their USR (the qualified name for
+// rows without one), which is the same in every snapshot, so no ids have to
+// be matched up. Each snapshot's calls become (caller hash, callee hash)
+// edges, sorted and collapsed with their flags OR'd and distinct call sites
+// (path, line, column) counted; one merge pass over the two sorted arrays
+// then yields the added, removed and changed edges. The snapshots are opened
+// read-only and loaded in parallel.
+class CallGraphDiff {
+public:
+    struct Counts {
+        size_t added = 0;
+        size_t removed = 0;
+        size_t changed = 0;   // same edge, different flags or call site count
+    };
+
+    bool load(const std::string& oldPath, const std::string& newPath);
+
+    // Streams one line per difference in hash order:
+    //   "+ caller -> callee", "- caller -> callee",
+    //   "~ caller -> callee  [flags a -> b] [calls n -> m]"
+    Counts write(std::ostream& out) const;
+
+private:
+    struct Edge {
+        uint64_t caller;
+        uint64_t callee;
+        uint32_t flags;   // ProjectDB::CallFlag bits of all its calls
+        uint32_t calls;   // distinct call sites
+    };
+
+    struct Snapshot {
+        std::vector<Edge> edges;
+        std::unordered_map<uint64_t, std::string> names;
+    };
+
+    Snapshot old_;
+    Snapshot new_;
+
+    static bool loadSnapshot(const std::string& path, Snapshot& snapshot);
+    // The qualified name, or "#<hash>" if the snapshot has none for it
+    static std::string name(const Snapshot& snapshot, uint64_t hash);
+};
@@ -0,0 +1,158 @@
+#include "CallPathQuery.h"
+#include <algorithm>
+#include <set>
+
+CallPathQuery::CallPathQuery(const CallGraph& graph)
+    : graph_(graph),
+      seenForward_(graph.nodeCount(), 0),
+      seenBackward_(graph.nodeCount(), 0),
+      parentForward_(graph.nodeCount(), CallGraph::kNone),
+      parentBackward_(graph.nodeCount(), CallGraph::kNone),
+      depthForward_(graph.nodeCount(), 0),
+      depthBackward_(graph.nodeCount(), 0),
+      blocked_(graph.nodeCount(), 0) {}
+
+std::vector<CallPathQuery::Path> CallPathQuery::findPaths(uint32_t from, uint32_t to,
+                                                          const Options& options) {
+    std::vector<Path> found;
+    Path first;
+    blockStamp_++;
+    if (options.maxPaths == 0 || !shortestPath(from, to, options.maxDepth, {}, first)) {
+        return found;
+    }
+    found.push_back(first);
+
+    // Yen's algorithm: candidates ordered by length, then by nodes for a
+    // deterministic order among equally long paths
+    std::set<std::pair<size_t, Path>> candidates;
+    while (found.size() < options.maxPaths) {
+        const Path previous = found.back();
+        for (size_t i = 0; i + 1 < previous.size(); i++) {
+            uint32_t spur = previous[i];
+
+            // Edges leaving the spur node along already known paths with the same root
+            std::unordered_set<uint32_t> blockedEdges;
+            for (const auto& path : found) {
+                if (path.size() > i + 1 && std::equal(previous.begin(), previous.begin() + i + 1, path.begin())) {
+                    blockedEdges.insert(graph_.findEdge(path[i], path[i + 1]));
+                }
+            }
+
+            // The root must not be revisited, or the path would loop
+            blockStamp_++;
+            for (size_t j = 0; j < i; j++) {
+                blocked_[previous[j]] = blockStamp_;
+            }
+
+            Path spurPath;
+            if (!shortestPath(spur, to, options.maxDepth - static_cast<unsigned>(i), blockedEdges, spurPath)) {
+                continue;
+            }
+            Path candidate(previous.begin(), previous.begin() + i);
+            candidate.insert(candidate.end(), spurPath.begin(), spurPath.end());
+            if (std::find(found.begin(), found.end(), candidate) == found.end()) {
+                candidates.emplace(candidate.size(), candidate);
+            }
+        }
+
+        if (candidates.empty()) {
+            break;
+        }
+        found.push_back(candidates.begin()->second);
+        candidates.erase(candidates.begin());
+    }
+    return found;
+}
+
+bool CallPathQuery::shortestPath(uint32_t from, uint32_t to, unsigned maxDepth,
+                                 const std::unordered_set<uint32_t>& blockedEdges, Path& path) {
+    uint32_t stamp = ++generation_;
+    auto isBlocked = [this](uint32_t node) { return blocked_[node] == blockStamp_; };
+    if (isBlocked(from) || isBlocked(to)) {
+        return false;
+    }
+
+    path.clear();
+    if (from == to) {
+        path.push_back(from);
+        return true;
+    }
+
+    seenForward_[from] = stamp;
+    parentForward_[from] = CallGraph::kNone;
+    depthForward_[from] = 0;
+    seenBackward_[to] = stamp;
+    parentBackward_[to] = CallGraph::kNone;
+    depthBackward_[to] = 0;
+
+    std::vector<uint32_t> forward{from};
+    std::vector<uint32_t> backward{to};
+    std::vector<uint32_t> next;
+    unsigned forwardDepth = 0;
+    unsigned backwardDepth = 0;
+    uint32_t meet = CallGraph::kNone;
+    unsigned best = UINT32_MAX;
+
+    while (!forward.empty() && !backward.empty() && forwardDepth + backwardDepth < maxDepth) {
+        next.clear();
+        // Expand whole levels of the smaller side; the first level that meets
+        // the other side holds the shortest path
+        if (forward.size() <= backward.size()) {
+            forwardDepth++;
+            for (uint32_t node : forward) {
+                for (uint32_t e = graph_.outBegin(node); e < graph_.outEnd(node); e++) {
+                    uint32_t callee = graph_.callee(e);
+                    if (seenForward_[callee] == stamp || isBlocked(callee) || blockedEdges.count(e)) {
+                        continue;
+                    }
+                    seenForward_[callee] = stamp;
+                    parentForward_[callee] = node;
+                    depthForward_[callee] = forwardDepth;
+                    next.push_back(callee);
+                    if (seenBackward_[callee] == stamp && forwardDepth + depthBackward_[callee] < best) {
+                        best = forwardDepth + depthBackward_[callee];
+                        meet = callee;
+                    }
+                }
+            }
+            forward.swap(next);
+        } else {
+            backwardDepth++;
+            for (uint32_t node : backward) {
+                for (uint32_t i = graph_.inBegin(node); i < graph_.inEnd(node); i++) {
+                    uint32_t caller = graph_.inCaller(i);
+                    if (seenBackward_[caller] == stamp || isBlocked(caller) ||
+                        blockedEdges.count(graph_.inEdge(i))) {
+                        continue;
+                    }
+                    seenBackward_[caller] = stamp;
+                    parentBackward_[caller] = node;
+                    depthBackward_[caller] = backwardDepth;
+                    next.push_back(caller);
+                    if (seenForward_[caller] == stamp && backwardDepth + depthForward_[caller] < best) {
+                        best = backwardDepth + depthForward_[caller];
+                        meet = caller;
+                    }
+                }
+            }
+            backward.swap(next);
+        }
+
+        if (meet != CallGraph::kNone) {
+            break;
+        }
+    }
+
+    if (meet == CallGraph::kNone || best > maxDepth) {
+        return false;
+    }
+
+    for (uint32_t node = meet; node != CallGraph::kNone; node = parentForward_[node]) {
+        path.push_back(node);
+    }
+    std::reverse(path.begin(), path.end());
+    for (uint32_t node = parentBackward_[meet]; node != CallGraph::kNone; node = parentBackward_[node]) {
+        path.push_back(node);
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+#include "CallGraph.h"
+
+// Shortest and K-shortest call paths between two functions.
+//
+// Single shortest paths come from a bidirectional BFS that always expands the
+// smaller frontier. K-shortest loopless paths use Yen's algorithm on top of
+// it, blocking the root path and the edges already used at each spur node.
+class CallPathQuery {
+public:
+    struct Options {
+        unsigned maxDepth = 10;  // calls per path
+        unsigned maxPaths = 1;
+    };
+
+    // A path is its nodes; hop i is the edge from nodes[i] to nodes[i + 1]
+    using Path = std::vector<uint32_t>;
+
+    explicit CallPathQuery(const CallGraph& graph);
+
+    // Paths in order of length, at most options.maxPaths
+    std::vector<Path> findPaths(uint32_t from, uint32_t to, const Options& options);
+
+private:
+    const CallGraph& graph_;
+
+    // Per-search state, reused across searches and invalidated by a generation
+    // stamp instead of being cleared
+    uint32_t generation_ = 0;
+    uint32_t blockStamp_ = 0;
+    std::vector<uint32_t> seenForward_;
+    std::vector<uint32_t> seenBackward_;
+    std::vector<uint32_t> parentForward_;
+    std::vector<uint32_t> parentBackward_;
+    std::vector<uint32_t> depthForward_;
+    std::vector<uint32_t> depthBackward_;
+    // Nodes equal to blockStamp_ are excluded from the current search
+    std::vector<uint32_t> blocked_;
+
+    bool shortestPath(uint32_t from, uint32_t to, unsigned maxDepth,
+                      const std::unordered_set<uint32_t>& blockedEdges, Path& path);
+};
@@ -0,0 +1,102 @@
+#include "CalleeClassifier.h"
+#include <cctype>
+
+// Qualified names of functions that run their argument on another thread
+static const char* const kAsyncSpawns[] = {
+    "std::async", "std::thread::thread", "std::jthread::jthread", "pthread_create"
+};
+
+static std::string spelling(CXCursor cursor) {
+    CXString name = clang_getCursorSpelling(cursor);
+    std::string result = clang_getCString(name);
+    clang_disposeString(name);
+    return result;
+}
+
+static bool isOperatorName(const std::string& name) {
+    // "operator+", "operator new", but not "operator_mode"
+    if (name.compare(0, 8, "operator") != 0 || name.size() == 8) {
+        return false;
+    }
+    char next = name[8];
+    return !(isalnum(static_cast<unsigned char>(next)) || next == '_');
+}
+
+CalleeClassifier::Callee CalleeClassifier::classify(CXCursor call, CXCursor callee, bool keep) {
+    if (!kept_.empty()) {
+        auto kept = kept_.find(call);
+        if (kept != kept_.end()) {
+            Callee result = kept->second;
+            kept_.erase(kept);
+            return result;
+        }
+    }
+
+    static const std::string kNoUsr;
+    CXString usr = clang_getCursorUSR(callee);
+    const char* key = clang_getCString(usr);
+    Callee result;
+    if (!key || !*key) {
+        // Declarations without a USR can't be shared
+        result = {classifyDeclaration(callee), &kNoUsr};
+    } else {
+        auto it = kinds_.find(key);
+        if (it == kinds_.end()) {
+            it = kinds_.emplace(key, classifyDeclaration(callee)).first;
+        }
+        // Keys of the map never move, so the USR is shared rather than copied
+        result = {it->second, &it->first};
+    }
+    clang_disposeString(usr);
+
+    // Qualified calls such as Base::f() bind statically
+    if ((result.kinds & VirtualDispatch) && !clang_Cursor_isDynamicCall(call)) {
+        result.kinds &= ~VirtualDispatch;
+    }
+    if (keep) {
+        kept_.emplace(call, result);
+    }
+    return result;
+}
+
+unsigned CalleeClassifier::classifyDeclaration(CXCursor callee) {
+    unsigned kinds = 0;
+    CXCursorKind kind = clang_getCursorKind(callee);
+    if (kind == CXCursor_CXXMethod && clang_CXXMethod_isVirtual(callee)) {
+        kinds |= VirtualDispatch;
+    }
+    if (!clang_Cursor_isNull(clang_getSpecializedCursorTemplate(callee))) {
+        kinds |= TemplateInstantiation;
+    }
+
+    // Library internals live in reserved namespaces (std::__1, std::__cxx11)
+    std::string name = spelling(callee);
+    std::string qualified = name;
+    std::string scope;
+    for (CXCursor parent = clang_getCursorSemanticParent(callee);
+         !clang_isInvalid(clang_getCursorKind(parent)) &&
+         clang_getCursorKind(parent) != CXCursor_TranslationUnit;
+         parent = clang_getCursorSemanticParent(parent)) {
+        std::string part = spelling(parent);
+        if (scope.empty()) {
+            scope = part;
+        }
+        if (clang_getCursorKind(parent) != CXCursor_Namespace || part.compare(0, 2, "__") != 0) {
+            qualified = part + "::" + qualified;
+        }
+    }
+
+    for (const char* spawn : kAsyncSpawns) {
+        if (qualified == spawn) {
+            kinds |= AsyncSpawn;
+        }
+    }
+    if (qualified == "std::function::operator()") {
+        kinds |= StdFunctionCall;
+    } else if (scope.compare(0, 8, "(lambda ") == 0) {
+        kinds |= Lambda;
+    } else if (kind == CXCursor_ConversionFunction || isOperatorName(name)) {
+        kinds |= Operator;
+    }
+    return kinds;
+}
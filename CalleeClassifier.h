@@ -0,0 +1,42 @@
+#pragma once
+#include <clang-c/Index.h>
+#include <string>
+#include <unordered_map>
+
+// Classifies call targets by declaration. Each callee is classified once,
+// the first time a call references it; later calls cost one USR lookup.
+// Passes over the same TU share the answer for each call, so the second pass
+// pays neither.
+class CalleeClassifier {
+public:
+    enum Kind {
+        VirtualDispatch = 1 << 0,        // virtual callee reached through a dynamic call
+        TemplateInstantiation = 1 << 1,
+        AsyncSpawn = 1 << 2,             // std::async, std::thread, pthread_create...
+        StdFunctionCall = 1 << 3,        // std::function::operator()
+        Operator = 1 << 4,               // overloaded operator, lambdas excluded
+        Lambda = 1 << 5                  // lambda call operator
+    };
+
+    struct Callee {
+        unsigned kinds;
+        const std::string* usr;   // empty if the callee has none
+    };
+
+    // Kinds and USR of one call; callee is the call's referenced cursor.
+    // keep stores the answer for a later pass, which takes it back out.
+    Callee classify(CXCursor call, CXCursor callee, bool keep = false);
+
+private:
+    struct CursorHash {
+        size_t operator()(const CXCursor& cursor) const { return clang_hashCursor(cursor); }
+    };
+    struct CursorEqual {
+        bool operator()(const CXCursor& a, const CXCursor& b) const { return clang_equalCursors(a, b); }
+    };
+
+    std::unordered_map<std::string, unsigned> kinds_;
+    std::unordered_map<CXCursor, Callee, CursorHash, CursorEqual> kept_;
+
+    static unsigned classifyDeclaration(CXCursor callee);
+};
@@ -0,0 +1,273 @@
+#include "ColumnarExporter.h"
+#include <iostream>
+#include "ProjectDB.h"
+
+static const char kMagic[] = "CGCOL2\n";
+
+ColumnarExporter::ColumnarExporter(const std::string& dbPath, size_t rowGroupSize)
+    : rowGroupSize_(rowGroupSize) {
+    if (sqlite3_open_v2(dbPath.c_str(), &db_, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Can't open database: " << sqlite3_errmsg(db_) << std::endl;
+    }
+}
+
+ColumnarExporter::~ColumnarExporter() {
+    if (out_) {
+        fclose(out_);
+    }
+    if (db_) {
+        sqlite3_close(db_);
+    }
+}
+
+bool ColumnarExporter::exportTo(const std::string& outPath) {
+    out_ = fopen(outPath.c_str(), "wb");
+    if (!out_) {
+        std::cerr << "Can't open output file: " << outPath << std::endl;
+        return false;
+    }
+    tableOffsets_.clear();
+
+    const Encoding Plain = Encoding::Plain, Rle = Encoding::Rle,
+                   Dict = Encoding::Dict, Bits = Encoding::Bits;
+
+    bool ok = write(std::string(kMagic, sizeof(kMagic) - 1));
+
+    ok = ok && exportTable("functions", R"(
+        SELECT f.id, f.name, f.qualified_name, f.return_type, files.path, f.line, f.column,
+               f.is_function_pointer, f.pointer_level, f.usr
+        FROM functions f LEFT JOIN files ON files.id = f.file_id ORDER BY f.id
+    )", {
+        {"id", Plain}, {"name", Dict}, {"qualified_name", Dict}, {"return_type", Dict},
+        {"file_path", Dict}, {"line", Rle}, {"column", Plain},
+        {"is_function_pointer", Bits}, {"pointer_level", Rle}, {"usr", Dict}
+    });
+
+    // The flags bitmask is exported as the separate bit columns of the format
+    auto flag = [](int bit) { return "c.flags & " + std::to_string(bit) + " != 0"; };
+    ok = ok && exportTable("calls", R"(
+        SELECT c.id, c.caller_id, c.callee_id, cf.path, c.call_line, c.call_column, )" +
+               flag(ProjectDB::CallVirtual) + ", " + flag(ProjectDB::CallTemplateInstantiation) + ", " +
+               flag(ProjectDB::CallExceptionPath) + ", " + flag(ProjectDB::CallMacroExpansion) + R"(,
+               mf.path, c.macro_definition_line, )" + flag(ProjectDB::CallDynamicCast) + R"(,
+               c.template_id, c.specialization_id, )" +
+               flag(ProjectDB::CallAsyncSpawn) + ", " + flag(ProjectDB::CallStdFunction) + ", " +
+               flag(ProjectDB::CallOperator) + R"(
+        FROM calls c
+        LEFT JOIN files cf ON cf.id = c.call_file_id
+        LEFT JOIN files mf ON mf.id = c.macro_definition_file_id
+        ORDER BY c.id
+    )", {
+        {"id", Plain}, {"caller_id", Rle}, {"callee_id", Plain},
+        {"call_file", Dict}, {"call_line", Rle}, {"call_column", Plain},
+        {"is_virtual_call", Bits}, {"is_template_instantiation", Bits},
+        {"is_exception_path", Bits}, {"is_macro_expansion", Bits},
+        {"macro_definition_file", Dict}, {"macro_definition_line", Rle},
+        {"is_dynamic_cast", Bits}, {"template_id", Rle}, {"specialization_id", Rle},
+        {"is_async_spawn", Bits}, {"is_std_function_call", Bits}, {"is_operator_call", Bits}
+    });
+
+    ok = ok && exportTable("classes", R"(
+        SELECT c.id, c.name, c.qualified_name, files.path, c.line, c.column, c.usr
+        FROM classes c LEFT JOIN files ON files.id = c.file_id ORDER BY c.id
+    )", {
+        {"id", Plain}, {"name", Dict}, {"qualified_name", Dict},
+        {"file_path", Dict}, {"line", Rle}, {"column", Plain}, {"usr", Dict}
+    });
+
+    if (ok) {
+        // Footer lets readers seek straight to a table
+        uint64_t footerOffset = static_cast<uint64_t>(ftell(out_));
+        std::string footer = "F";
+        putVarint(footer, tableOffsets_.size());
+        for (const auto& table : tableOffsets_) {
+            putString(footer, table.first);
+            putVarint(footer, table.second);
+        }
+        for (int i = 0; i < 8; i++) {
+            footer.push_back(static_cast<char>((footerOffset >> (8 * i)) & 0xff));
+        }
+        ok = write(footer);
+    }
+
+    ok = (fclose(out_) == 0) && ok;
+    out_ = nullptr;
+    return ok;
+}
+
+bool ColumnarExporter::exportTable(const std::string& name, const std::string& query,
+                                   const std::vector<ColumnSpec>& specs) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db_) << std::endl;
+        return false;
+    }
+
+    tableOffsets_.emplace_back(name, static_cast<uint64_t>(ftell(out_)));
+
+    std::string header = "T";
+    putString(header, name);
+    putVarint(header, specs.size());
+    for (const auto& spec : specs) {
+        putString(header, spec.name);
+        header.push_back(static_cast<char>(spec.encoding));
+    }
+    if (!write(header)) {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+
+    std::vector<Column> columns(specs.size());
+    for (size_t i = 0; i < specs.size(); i++) {
+        columns[i].spec = specs[i];
+        columns[i].values.reserve(rowGroupSize_);
+        columns[i].nulls.reserve(rowGroupSize_);
+    }
+
+    uint64_t totalRows = 0;
+    size_t rows = 0;
+    bool ok = true;
+    int rc;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        for (size_t i = 0; i < columns.size(); i++) {
+            Column& column = columns[i];
+            int col = static_cast<int>(i);
+            bool isNull = sqlite3_column_type(stmt, col) == SQLITE_NULL;
+            column.nulls.push_back(isNull);
+            column.hasNulls = column.hasNulls || isNull;
+            if (isNull) {
+                column.values.push_back(0);
+            } else if (column.spec.encoding == Encoding::Dict) {
+                std::string value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+                auto inserted = column.dictionary.emplace(value, static_cast<uint32_t>(column.dictionary.size()));
+                if (inserted.second) {
+                    column.entries.push_back(value);
+                }
+                column.values.push_back(inserted.first->second);
+            } else if (column.spec.encoding == Encoding::Bits) {
+                column.values.push_back(sqlite3_column_int(stmt, col) ? 1 : 0);
+            } else {
+                column.values.push_back(sqlite3_column_int64(stmt, col));
+            }
+        }
+        totalRows++;
+        if (++rows == rowGroupSize_) {
+            ok = flushRowGroup(columns, rows);
+            rows = 0;
+        }
+    }
+    if (ok && rc != SQLITE_DONE) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db_) << std::endl;
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+
+    if (ok && rows > 0) {
+        ok = flushRowGroup(columns, rows);
+    }
+    if (ok) {
+        std::string trailer = "E";
+        putVarint(trailer, totalRows);
+        ok = write(trailer);
+    }
+    return ok;
+}
+
+bool ColumnarExporter::flushRowGroup(std::vector<Column>& columns, size_t rows) {
+    std::string group = "G";
+    putVarint(group, rows);
+    std::string chunk;
+    for (auto& column : columns) {
+        chunk.clear();
+        encodeColumn(column, rows, chunk);
+        putVarint(group, chunk.size());
+        group += chunk;
+        column.values.clear();
+        column.nulls.clear();
+        column.hasNulls = false;
+        column.dictionary.clear();
+        column.entries.clear();
+    }
+    return write(group);
+}
+
+void ColumnarExporter::encodeColumn(Column& column, size_t rows, std::string& chunk) {
+    chunk.push_back(column.hasNulls ? 1 : 0);
+    if (column.hasNulls) {
+        putBits(chunk, column.nulls);
+    }
+
+    switch (column.spec.encoding) {
+        case Encoding::Plain:
+            for (int64_t value : column.values) {
+                putSigned(chunk, value);
+            }
+            break;
+        case Encoding::Rle:
+            putRuns(chunk, column.values);
+            break;
+        case Encoding::Dict:
+            putVarint(chunk, column.entries.size());
+            for (const auto& entry : column.entries) {
+                putString(chunk, entry);
+            }
+            putRuns(chunk, column.values);
+            break;
+        case Encoding::Bits: {
+            std::vector<bool> bits(rows);
+            for (size_t i = 0; i < rows; i++) {
+                bits[i] = column.values[i] != 0;
+            }
+            putBits(chunk, bits);
+            break;
+        }
+    }
+}
+
+bool ColumnarExporter::write(const std::string& bytes) {
+    if (fwrite(bytes.data(), 1, bytes.size(), out_) != bytes.size()) {
+        std::cerr << "Failed to write columnar output" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ColumnarExporter::putVarint(std::string& buf, uint64_t value) {
+    while (value >= 0x80) {
+        buf.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    buf.push_back(static_cast<char>(value));
+}
+
+void ColumnarExporter::putSigned(std::string& buf, int64_t value) {
+    putVarint(buf, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void ColumnarExporter::putString(std::string& buf, const std::string& value) {
+    putVarint(buf, value.size());
+    buf += value;
+}
+
+void ColumnarExporter::putBits(std::string& buf, const std::vector<bool>& bits) {
+    std::string bytes((bits.size() + 7) / 8, '\0');
+    for (size_t i = 0; i < bits.size(); i++) {
+        if (bits[i]) {
+            bytes[i / 8] = static_cast<char>(bytes[i / 8] | (1 << (i % 8)));
+        }
+    }
+    buf += bytes;
+}
+
+void ColumnarExporter::putRuns(std::string& buf, const std::vector<int64_t>& values) {
+    size_t i = 0;
+    while (i < values.size()) {
+        size_t run = 1;
+        while (i + run < values.size() && values[i + run] == values[i]) {
+            run++;
+        }
+        putSigned(buf, values[i]);
+        putVarint(buf, run);
+        i += run;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <sqlite3.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Streams the functions, calls and classes tables of a callgraph database into
+// a column-oriented file for analytics engines.
+//
+// File layout (all integers are LEB128 varints, signed values zigzag-encoded):
+//   "CGCOL2\n"
+//   per table:   'T' name ncols { name encoding }...
+//                'G' nrows { chunk-bytes chunk }...   (one per row group)
+//                'E' total-rows
+//   footer:      'F' ntables { name offset }...  then 8-byte little-endian
+//                offset of the 'F' tag
+//
+// Every column chunk starts with a null byte: 0, or 1 followed by a bitmap of
+// ceil(nrows / 8) bytes, LSB first, with a bit set for each NULL row. NULL
+// rows hold 0 (id 0 for Dict) in the encoded values.
+//
+// Column chunk encodings:
+//   Plain   - varint per value
+//   Rle     - runs of (value, run-length)
+//   Dict    - the row group's dictionary (count, {len bytes}), then Rle over
+//             its ids; every row group has its own dictionary
+//   Bits    - values bit-packed LSB first, ceil(nrows / 8) bytes
+//
+// Only one row group per table is buffered at a time, dictionaries included.
+class ColumnarExporter {
+public:
+    enum class Encoding : uint8_t { Plain = 0, Rle = 1, Dict = 2, Bits = 3 };
+
+    struct ColumnSpec {
+        std::string name;
+        Encoding encoding;
+    };
+
+    ColumnarExporter(const std::string& dbPath, size_t rowGroupSize = 65536);
+    ~ColumnarExporter();
+
+    bool exportTo(const std::string& outPath);
+
+private:
+    struct Column {
+        ColumnSpec spec;
+        std::vector<int64_t> values;
+        std::vector<bool> nulls;
+        bool hasNulls = false;
+        std::unordered_map<std::string, uint32_t> dictionary;
+        std::vector<std::string> entries;
+    };
+
+    sqlite3* db_;
+    size_t rowGroupSize_;
+    FILE* out_ = nullptr;
+    std::vector<std::pair<std::string, uint64_t>> tableOffsets_;
+
+    bool exportTable(const std::string& name, const std::string& query,
+                     const std::vector<ColumnSpec>& specs);
+    bool flushRowGroup(std::vector<Column>& columns, size_t rows);
+    void encodeColumn(Column& column, size_t rows, std::string& chunk);
+
+    bool write(const std::string& bytes);
+    static void putVarint(std::string& buf, uint64_t value);
+    static void putSigned(std::string& buf, int64_t value);
+    static void putString(std::string& buf, const std::string& value);
+    static void putBits(std::string& buf, const std::vector<bool>& bits);
+    static void putRuns(std::string& buf, const std::vector<int64_t>& values);
+};
@@ -0,0 +1,86 @@
+#include "CompileCommands.h"
+#include <iostream>
+#include <set>
+
+CompileCommands::~CompileCommands() {
+    if (db_) {
+        clang_CompilationDatabase_dispose(db_);
+    }
+}
+
+bool CompileCommands::load(const std::string& buildDir) {
+    CXCompilationDatabase_Error error;
+    db_ = clang_CompilationDatabase_fromDirectory(buildDir.c_str(), &error);
+    if (error != CXCompilationDatabase_NoError || !db_) {
+        std::cerr << "Can't load compilation database from " << buildDir << std::endl;
+        db_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> CompileCommands::files() const {
+    std::vector<std::string> result;
+    if (!db_) {
+        return result;
+    }
+
+    // A file compiled in several configurations is indexed once
+    std::set<std::string> seen;
+    CXCompileCommands commands = clang_CompilationDatabase_getAllCompileCommands(db_);
+    unsigned count = clang_CompileCommands_getSize(commands);
+    for (unsigned i = 0; i < count; i++) {
+        CXCompileCommand command = clang_CompileCommands_getCommand(commands, i);
+        std::string path = absolutePath(toString(clang_CompileCommand_getDirectory(command)),
+                                        toString(clang_CompileCommand_getFilename(command)));
+        if (seen.insert(path).second) {
+            result.push_back(path);
+        }
+    }
+    clang_CompileCommands_dispose(commands);
+    return result;
+}
+
+std::vector<std::string> CompileCommands::argumentsFor(const std::string& file) const {
+    std::vector<std::string> result;
+    if (!db_) {
+        return result;
+    }
+
+    CXCompileCommands commands = clang_CompilationDatabase_getCompileCommands(db_, file.c_str());
+    if (commands && clang_CompileCommands_getSize(commands) > 0) {
+        CXCompileCommand command = clang_CompileCommands_getCommand(commands, 0);
+        std::string directory = toString(clang_CompileCommand_getDirectory(command));
+        std::string filename = toString(clang_CompileCommand_getFilename(command));
+
+        // Argument 0 is the compiler itself
+        unsigned numArgs = clang_CompileCommand_getNumArgs(command);
+        for (unsigned i = 1; i < numArgs; i++) {
+            std::string arg = toString(clang_CompileCommand_getArg(command, i));
+            if (arg == "-o") {
+                i++;
+            } else if (arg != "-c" && arg != filename && absolutePath(directory, arg) != file) {
+                result.push_back(arg);
+            }
+        }
+        result.push_back("-working-directory=" + directory);
+    }
+    if (commands) {
+        clang_CompileCommands_dispose(commands);
+    }
+    return result;
+}
+
+std::string CompileCommands::toString(CXString str) {
+    const char* cstr = clang_getCString(str);
+    std::string result = cstr ? cstr : "";
+    clang_disposeString(str);
+    return result;
+}
+
+std::string CompileCommands::absolutePath(const std::string& directory, const std::string& file) {
+    if (file.empty() || file[0] == '/' || directory.empty()) {
+        return file;
+    }
+    return directory + "/" + file;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <clang-c/CXCompilationDatabase.h>
+#include <string>
+#include <vector>
+
+// Thin wrapper over libclang's compile_commands.json support
+class CompileCommands {
+public:
+    CompileCommands() = default;
+    ~CompileCommands();
+
+    CompileCommands(const CompileCommands&) = delete;
+    CompileCommands& operator=(const CompileCommands&) = delete;
+
+    bool load(const std::string& buildDir);
+    bool loaded() const { return db_ != nullptr; }
+
+    // Absolute paths of every file in the database
+    std::vector<std::string> files() const;
+
+    // Parser arguments for a file: the recorded command without the compiler,
+    // the input and output, run in the recorded directory. Empty if unknown.
+    std::vector<std::string> argumentsFor(const std::string& file) const;
+
+private:
+    CXCompilationDatabase db_ = nullptr;
+
+    static std::string toString(CXString str);
+    static std::string absolutePath(const std::string& directory, const std::string& file);
+};
@@ -0,0 +1,302 @@
+#include "EventStream.h"
+#include <sys/stat.h>
+#include <limits.h>
+#include <unistd.h>
+#include <cerrno>
+#include "CalleeClassifier.h"
+
+// Buffers formatted but not yet written; the visitor waits beyond this
+static const size_t kMaxQueued = 4;
+
+static void putVarint(std::string& buf, uint64_t value) {
+    while (value >= 0x80) {
+        buf.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    buf.push_back(static_cast<char>(value));
+}
+
+static size_t varintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static void putString(std::string& buf, std::string_view value) {
+    putVarint(buf, value.size());
+    buf.append(value.data(), value.size());
+}
+
+// Bytes that must be escaped inside JSON strings
+static const struct JsonEscapeTable {
+    bool escape[256] = {};
+    JsonEscapeTable() {
+        for (int c = 0; c < 0x20; c++) escape[c] = true;
+        escape['"'] = escape['\\'] = true;
+    }
+    bool operator[](unsigned char c) const { return escape[c]; }
+} kJsonEscape;
+
+static void putJsonString(std::string& out, std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    // Copy runs that need no escaping in one append
+    size_t run = 0;
+    const char* data = value.data();
+    for (size_t i = 0; i < value.size(); i++) {
+        unsigned char c = data[i];
+        if (!kJsonEscape[c]) {
+            continue;
+        }
+        out.append(value.data() + run, i - run);
+        run = i + 1;
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else {
+            out += "\\u00";
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0xf]);
+        }
+    }
+    out.append(value.data() + run, value.size() - run);
+    out.push_back('"');
+}
+
+static const char* typeName(Event::Type type) {
+    switch (type) {
+        case Event::Call: return "call";
+        case Event::Macro: return "macro";
+        case Event::Constructor: return "constructor";
+        case Event::Destructor: return "destructor";
+        case Event::Try: return "try";
+        case Event::Catch: return "catch";
+        case Event::Throw: return "throw";
+        case Event::DynamicCast: return "dynamic_cast";
+        case Event::Typeid: return "typeid";
+        case Event::DynamicCallWarning: return "dynamic_call";
+        case Event::VirtualCallWarning: return "virtual_call";
+        case Event::AsyncSpawn: return "async";
+    }
+    return "unknown";
+}
+
+EventStream::EventStream(Format format, int fd, size_t bufferSize)
+    : format_(format), fd_(fd), bufferSize_(bufferSize) {
+    struct stat st;
+    pipe_ = fstat(fd_, &st) == 0 && S_ISFIFO(st.st_mode);
+    current_.data.reserve(bufferSize_ + 4096);
+    writer_ = std::thread(&EventStream::writerLoop, this);
+}
+
+EventStream::~EventStream() {
+    if (!current_.data.empty()) {
+        handOff();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    queued_.notify_one();
+    writer_.join();
+}
+
+bool EventStream::parseFormat(const std::string& name, Format& format) {
+    if (name == "text") {
+        format = Format::Text;
+    } else if (name == "ndjson") {
+        format = Format::Ndjson;
+    } else if (name == "binary") {
+        format = Format::Binary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void EventStream::emit(const Event& event) {
+    size_t start = current_.data.size();
+    switch (format_) {
+        case Format::Text: formatText(event, current_.data); break;
+        case Format::Ndjson: formatNdjson(event, current_.data); break;
+        case Format::Binary: formatBinary(event, current_.data); break;
+    }
+
+    // Close the chunk before an event that would overflow it
+    if (pipe_ && current_.data.size() - chunkStart_ > PIPE_BUF && start > chunkStart_) {
+        current_.cuts.push_back(start);
+        chunkStart_ = start;
+    }
+    if (current_.data.size() >= bufferSize_) {
+        handOff();
+    }
+}
+
+void EventStream::formatText(const Event& event, std::string& out) {
+    switch (event.type) {
+        case Event::Call: {
+            out.append(event.caller).append(" -> ");
+            if (event.kinds & CalleeClassifier::VirtualDispatch) out += "[virtual] ";
+            if (event.kinds & CalleeClassifier::Lambda) out += "[lambda] ";
+            else if (event.kinds & CalleeClassifier::StdFunctionCall) out += "[std::function] ";
+            else if (event.kinds & CalleeClassifier::TemplateInstantiation) out += "[template] ";
+            else if (event.kinds & CalleeClassifier::Operator) out += "[operator] ";
+            out.append(event.name);
+            break;
+        }
+        case Event::Macro:
+            out.append("[macro] ").append(event.name)
+               .append("\n  Defined at: ").append(event.definitionFile)
+               .append(":").append(std::to_string(event.definitionLine))
+               .append("\n  Expanded at: ").append(event.file)
+               .append(":").append(std::to_string(event.line));
+            break;
+        case Event::Constructor: out.append("[constructor] ").append(event.name); break;
+        case Event::Destructor: out.append("[destructor] ").append(event.name); break;
+        case Event::Try: out += "[try-block]"; break;
+        case Event::Catch: out.append("[catch] ").append(event.name); break;
+        case Event::Throw: out += "[throw]"; break;
+        case Event::DynamicCast: out.append("[dynamic_cast] ").append(event.name); break;
+        case Event::Typeid: out.append("[typeid] ").append(event.name); break;
+        case Event::DynamicCallWarning:
+            out += "[warning] Dynamic call - call chain may be incomplete";
+            break;
+        case Event::VirtualCallWarning:
+            out += "[warning] Virtual call - runtime target may vary";
+            break;
+        case Event::AsyncSpawn:
+            out.append("[async] ").append(event.name)
+               .append("\n  Called from: ").append(event.file)
+               .append(":").append(std::to_string(event.line));
+            break;
+    }
+    out.push_back('\n');
+}
+
+void EventStream::formatNdjson(const Event& event, std::string& out) {
+    out += "{\"event\":\"";
+    out += typeName(event.type);
+    out.push_back('"');
+    if (!event.name.empty()) {
+        out += ",\"name\":";
+        putJsonString(out, event.name);
+    }
+    if (!event.caller.empty()) {
+        out += ",\"caller\":";
+        putJsonString(out, event.caller);
+    }
+    if (event.kinds != 0) {
+        static const std::pair<unsigned, const char*> kindNames[] = {
+            {CalleeClassifier::VirtualDispatch, "virtual"},
+            {CalleeClassifier::TemplateInstantiation, "template"},
+            {CalleeClassifier::AsyncSpawn, "async"},
+            {CalleeClassifier::StdFunctionCall, "std_function"},
+            {CalleeClassifier::Operator, "operator"},
+            {CalleeClassifier::Lambda, "lambda"}
+        };
+        out += ",\"kinds\":[";
+        bool first = true;
+        for (const auto& kind : kindNames) {
+            if (event.kinds & kind.first) {
+                out += first ? "\"" : ",\"";
+                out += kind.second;
+                out.push_back('"');
+                first = false;
+            }
+        }
+        out.push_back(']');
+    }
+    if (!event.file.empty()) {
+        out += ",\"file\":";
+        putJsonString(out, event.file);
+        out += ",\"line\":" + std::to_string(event.line);
+    }
+    if (!event.definitionFile.empty()) {
+        out += ",\"definition_file\":";
+        putJsonString(out, event.definitionFile);
+        out += ",\"definition_line\":" + std::to_string(event.definitionLine);
+    }
+    out += "}\n";
+}
+
+void EventStream::formatBinary(const Event& event, std::string& out) {
+    // The length prefix comes first, so size the fields up front
+    size_t size = 1 + varintSize(event.kinds) +
+                  varintSize(event.name.size()) + event.name.size() +
+                  varintSize(event.caller.size()) + event.caller.size() +
+                  varintSize(event.file.size()) + event.file.size() + varintSize(event.line) +
+                  varintSize(event.definitionFile.size()) + event.definitionFile.size() +
+                  varintSize(event.definitionLine);
+    putVarint(out, size);
+    out.push_back(static_cast<char>(event.type));
+    putVarint(out, event.kinds);
+    putString(out, event.name);
+    putString(out, event.caller);
+    putString(out, event.file);
+    putVarint(out, event.line);
+    putString(out, event.definitionFile);
+    putVarint(out, event.definitionLine);
+}
+
+void EventStream::handOff() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_.wait(lock, [this] { return queue_.size() < kMaxQueued; });
+    queue_.push_back(std::move(current_));
+    if (spare_.empty()) {
+        current_ = Buffer();
+        current_.data.reserve(bufferSize_ + 4096);
+    } else {
+        current_ = std::move(spare_.back());
+        spare_.pop_back();
+    }
+    chunkStart_ = 0;
+    lock.unlock();
+    queued_.notify_one();
+}
+
+void EventStream::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        queued_.wait(lock, [this] { return !queue_.empty() || closing_; });
+        if (queue_.empty()) {
+            return;
+        }
+        Buffer buffer = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        // After a failed write (closed pipe, full disk) the rest is dropped
+        size_t begin = 0;
+        buffer.cuts.push_back(buffer.data.size());
+        for (size_t end : buffer.cuts) {
+            if (!failed_ && !writeAll(buffer.data.data() + begin, end - begin)) {
+                failed_ = true;
+            }
+            begin = end;
+        }
+
+        buffer.data.clear();
+        buffer.cuts.clear();
+        lock.lock();
+        spare_.push_back(std::move(buffer));
+        drained_.notify_one();
+    }
+}
+
+bool EventStream::writeAll(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
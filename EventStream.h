@@ -0,0 +1,93 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// One finding of the report visitor. Strings are borrowed for the duration
+// of EventStream::emit; unused fields stay empty or zero.
+struct Event {
+    enum Type : uint8_t {
+        Call = 1,
+        Macro,
+        Constructor,
+        Destructor,
+        Try,
+        Catch,
+        Throw,
+        DynamicCast,
+        Typeid,
+        DynamicCallWarning,
+        VirtualCallWarning,
+        AsyncSpawn
+    };
+
+    Type type;
+    unsigned kinds = 0;              // Call: CalleeClassifier::Kind bits
+    std::string_view name;           // callee, macro, symbol or type
+    std::string_view caller;         // Call
+    std::string_view file;           // macro expansion or spawn site
+    unsigned line = 0;
+    std::string_view definitionFile; // Macro
+    unsigned definitionLine = 0;
+};
+
+// Formats events into large buffers that a writer thread drains to a file
+// descriptor, so the visitor never blocks on output until a few buffers are
+// queued.
+//
+// Formats:
+//   Text    - the human-readable report, one or more lines per event
+//   Ndjson  - one JSON object per line: {"event":"call","caller":...}
+//   Binary  - per event: varint length of the rest, type byte, then
+//             varint kinds, name, caller, file, varint line, definition
+//             file, varint definition line; strings are varint length + bytes
+//
+// Output to a pipe is written in chunks of at most PIPE_BUF bytes cut at
+// event boundaries, so worker processes sharing the pipe never split an
+// event.
+class EventStream {
+public:
+    enum class Format { Text, Ndjson, Binary };
+
+    explicit EventStream(Format format, int fd = 1, size_t bufferSize = 1 << 20);
+    // Flushes everything emitted
+    ~EventStream();
+
+    void emit(const Event& event);
+
+    static bool parseFormat(const std::string& name, Format& format);
+
+private:
+    struct Buffer {
+        std::string data;
+        std::vector<size_t> cuts;   // chunk ends for pipes
+    };
+
+    Format format_;
+    int fd_;
+    size_t bufferSize_;
+    bool pipe_;
+    Buffer current_;
+    size_t chunkStart_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable drained_;
+    std::deque<Buffer> queue_;
+    std::vector<Buffer> spare_;
+    bool closing_ = false;
+    bool failed_ = false;
+    std::thread writer_;
+
+    void formatText(const Event& event, std::string& out);
+    void formatNdjson(const Event& event, std::string& out);
+    void formatBinary(const Event& event, std::string& out);
+    void handOff();
+    void writerLoop();
+    bool writeAll(const char* data, size_t size);
+};
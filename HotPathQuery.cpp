@@ -0,0 +1,105 @@
+#include "HotPathQuery.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <iostream>
+#include <queue>
+
+HotPathQuery::HotPathQuery(const CallGraph& graph) : graph_(graph), callers_(graph.nodeCount()) {}
+
+bool HotPathQuery::load(const std::string& dbPath) {
+    sqlite3* db;
+    if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT caller_id, callee_id, inclusive_weight FROM edge_samples";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "No profile in database, run import-profile first" << std::endl;
+        sqlite3_close(db);
+        return false;
+    }
+
+    size_t edges = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        uint32_t caller = graph_.nodeForFunction(sqlite3_column_int64(stmt, 0));
+        uint32_t callee = graph_.nodeForFunction(sqlite3_column_int64(stmt, 1));
+        long long weight = sqlite3_column_int64(stmt, 2);
+        if (caller != CallGraph::kNone && callee != CallGraph::kNone && weight > 0) {
+            callers_[callee].push_back({caller, weight});
+            edges++;
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    if (edges == 0) {
+        std::cerr << "No profile in database, run import-profile first" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<HotPathQuery::Path> HotPathQuery::hottestPathsInto(uint32_t target,
+                                                               const Options& options) const {
+    // Partial paths form a tree rooted at the target; each entry extends its
+    // parent by one caller
+    struct Entry {
+        uint32_t node;
+        uint32_t parent;
+        unsigned depth;
+        long long hopWeight;
+        long long weight;
+    };
+    std::vector<Entry> entries;
+    auto hotter = [&entries](uint32_t a, uint32_t b) { return entries[a].weight < entries[b].weight; };
+    std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(hotter)> queue(hotter);
+
+    entries.push_back({target, CallGraph::kNone, 0, 0, INT64_MAX});
+    queue.push(0);
+    std::vector<unsigned> expanded(graph_.nodeCount(), 0);
+    std::vector<Path> paths;
+
+    while (!queue.empty() && paths.size() < options.maxPaths) {
+        uint32_t index = queue.top();
+        queue.pop();
+        Entry entry = entries[index];
+        if (expanded[entry.node]++ >= options.maxPaths) {
+            continue;
+        }
+
+        bool extended = false;
+        if (entry.depth < options.maxDepth) {
+            for (const Caller& caller : callers_[entry.node]) {
+                // Keep paths loop free
+                bool onPath = false;
+                for (uint32_t i = index; i != CallGraph::kNone && !onPath; i = entries[i].parent) {
+                    onPath = entries[i].node == caller.node;
+                }
+                if (onPath) {
+                    continue;
+                }
+                entries.push_back({caller.node, index, entry.depth + 1, caller.weight,
+                                   std::min(entry.weight, caller.weight)});
+                queue.push(static_cast<uint32_t>(entries.size() - 1));
+                extended = true;
+            }
+        }
+
+        // Entry points, depth-limited and looping paths end here
+        if (!extended && entry.depth > 0) {
+            Path path;
+            path.weight = entry.weight;
+            for (uint32_t i = index; i != CallGraph::kNone; i = entries[i].parent) {
+                path.nodes.push_back(entries[i].node);
+                if (entries[i].parent != CallGraph::kNone) {
+                    path.weights.push_back(entries[i].hopWeight);
+                }
+            }
+            paths.push_back(path);
+        }
+    }
+    return paths;
+}
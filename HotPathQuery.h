@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CallGraph.h"
+
+// Ranks the call paths leading into a function by imported profile weight.
+//
+// A path is only as hot as its coldest edge, so paths are scored by their
+// minimum edge inclusive weight. The search runs backwards from the target
+// over profiled edges, best first; since extending a path can only lower its
+// score, paths complete in score order. Each node is expanded at most
+// maxPaths times, which bounds the work on densely connected graphs.
+class HotPathQuery {
+public:
+    struct Options {
+        unsigned maxDepth = 10;
+        unsigned maxPaths = 5;
+    };
+
+    struct Path {
+        std::vector<uint32_t> nodes;       // entry point first, target last
+        std::vector<long long> weights;    // inclusive weight of each hop
+        long long weight;                  // minimum of weights
+    };
+
+    explicit HotPathQuery(const CallGraph& graph);
+
+    // Loads edge_samples; fails if the database has no profile
+    bool load(const std::string& dbPath);
+
+    std::vector<Path> hottestPathsInto(uint32_t target, const Options& options) const;
+
+private:
+    struct Caller {
+        uint32_t node;
+        long long weight;
+    };
+
+    const CallGraph& graph_;
+    // Profiled callers of each node
+    std::vector<std::vector<Caller>> callers_;
+};
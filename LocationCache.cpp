@@ -0,0 +1,37 @@
+#include "LocationCache.h"
+
+LocationCache::LocationCache() : paths_(1) {}
+
+LocationCache::Location LocationCache::decode(CXCursor cursor) {
+    return decode(clang_getCursorLocation(cursor));
+}
+
+LocationCache::Location LocationCache::decode(CXSourceLocation loc) {
+    Location result;
+    CXFile file = nullptr;
+    clang_getExpansionLocation(loc, &file, &result.line, &result.column, &result.offset);
+    result.fileId = internFile(file);
+    return result;
+}
+
+unsigned LocationCache::internFile(CXFile file) {
+    if (!file) {
+        return 0;
+    }
+    // Consecutive cursors almost always share a file
+    if (file == lastFile_) {
+        return lastFileId_;
+    }
+
+    auto it = fileIds_.find(file);
+    if (it == fileIds_.end()) {
+        CXString fileName = clang_getFileName(file);
+        paths_.push_back(clang_getCString(fileName));
+        clang_disposeString(fileName);
+        it = fileIds_.emplace(file, static_cast<unsigned>(paths_.size() - 1)).first;
+    }
+
+    lastFile_ = file;
+    lastFileId_ = it->second;
+    return lastFileId_;
+}
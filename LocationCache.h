@@ -0,0 +1,34 @@
+#pragma once
+#include <clang-c/Index.h>
+#include <clang-c/CXSourceLocation.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Decodes cursor locations once and interns their file paths.
+// File id 0 is reserved for locations without a file (builtins, invalid).
+class LocationCache {
+public:
+    struct Location {
+        unsigned fileId;
+        unsigned line;
+        unsigned column;
+        unsigned offset;
+    };
+
+    LocationCache();
+
+    Location decode(CXCursor cursor);
+    Location decode(CXSourceLocation loc);
+
+    const std::string& path(unsigned fileId) const { return paths_[fileId]; }
+    const std::vector<std::string>& paths() const { return paths_; }
+
+private:
+    std::unordered_map<CXFile, unsigned> fileIds_;
+    std::vector<std::string> paths_;
+    CXFile lastFile_ = nullptr;
+    unsigned lastFileId_ = 0;
+
+    unsigned internFile(CXFile file);
+};
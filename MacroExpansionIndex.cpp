@@ -0,0 +1,62 @@
+#include "MacroExpansionIndex.h"
+#include <algorithm>
+
+namespace {
+
+struct BuildContext {
+    LocationCache* locations;
+    std::vector<MacroExpansionIndex::Expansion>* expansions;
+};
+
+}
+
+void MacroExpansionIndex::build(CXTranslationUnit tu, LocationCache& locations) {
+    expansions_.clear();
+    BuildContext context{&locations, &expansions_};
+
+    // Preprocessing record entries are direct children of the TU cursor, so
+    // only the top level is scanned
+    clang_visitChildren(clang_getTranslationUnitCursor(tu),
+        [](CXCursor c, CXCursor parent, CXClientData client_data) {
+            if (clang_getCursorKind(c) != CXCursor_MacroExpansion) {
+                return CXChildVisit_Continue;
+            }
+            auto* context = static_cast<BuildContext*>(client_data);
+
+            CXSourceRange extent = clang_getCursorExtent(c);
+            LocationCache::Location begin = context->locations->decode(clang_getRangeStart(extent));
+            LocationCache::Location end = context->locations->decode(clang_getRangeEnd(extent));
+
+            Expansion expansion{begin.fileId, begin.offset, end.offset, 0, 0};
+            CXCursor definition = clang_getCursorReferenced(c);
+            if (!clang_Cursor_isNull(definition) &&
+                clang_getCursorKind(definition) == CXCursor_MacroDefinition) {
+                LocationCache::Location defLoc = context->locations->decode(definition);
+                expansion.definitionFileId = defLoc.fileId;
+                expansion.definitionLine = defLoc.line;
+            }
+            context->expansions->push_back(expansion);
+            return CXChildVisit_Continue;
+        }, &context);
+
+    std::sort(expansions_.begin(), expansions_.end(),
+        [](const Expansion& a, const Expansion& b) {
+            return a.fileId != b.fileId ? a.fileId < b.fileId : a.begin < b.begin;
+        });
+}
+
+const MacroExpansionIndex::Expansion* MacroExpansionIndex::find(unsigned fileId, unsigned offset) const {
+    // First expansion starting after the offset; its predecessor is the candidate
+    auto it = std::upper_bound(expansions_.begin(), expansions_.end(), std::make_pair(fileId, offset),
+        [](const std::pair<unsigned, unsigned>& key, const Expansion& e) {
+            return key.first != e.fileId ? key.first < e.fileId : key.second < e.begin;
+        });
+    if (it == expansions_.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (it->fileId != fileId || offset > it->end) {
+        return nullptr;
+    }
+    return &*it;
+}
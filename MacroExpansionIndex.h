@@ -0,0 +1,29 @@
+#pragma once
+#include <clang-c/Index.h>
+#include <vector>
+#include "LocationCache.h"
+
+// Macro expansions of a translation unit, taken from its preprocessing record
+// (requires CXTranslationUnit_DetailedPreprocessingRecord) and sorted by
+// (file, offset) so a location can be mapped to its expansion by binary search.
+class MacroExpansionIndex {
+public:
+    struct Expansion {
+        unsigned fileId;
+        unsigned begin;
+        unsigned end;
+        unsigned definitionFileId;
+        unsigned definitionLine;
+    };
+
+    void build(CXTranslationUnit tu, LocationCache& locations);
+    void clear() { expansions_.clear(); }
+
+    // Returns the expansion covering the given file offset, or nullptr
+    const Expansion* find(unsigned fileId, unsigned offset) const;
+
+    size_t size() const { return expansions_.size(); }
+
+private:
+    std::vector<Expansion> expansions_;
+};
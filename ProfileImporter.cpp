@@ -0,0 +1,253 @@
+#include "ProfileImporter.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "ProjectDB.h"
+
+// Marks lookup keys shared by several functions
+static const uint32_t kAmbiguous = CallGraph::kNone - 1;
+
+static std::string withoutParameters(const std::string& name) {
+    // "ns::f<int>(int) const" -> "ns::f<int>"; operator() keeps its parens
+    return name.substr(0, CallGraph::parameterListStart(name));
+}
+
+static std::string withoutScope(const std::string& name) {
+    // Last "::" outside template arguments and parameters
+    int depth = 0;
+    size_t last = std::string::npos;
+    for (size_t i = 0; i + 1 < name.size(); i++) {
+        char c = name[i];
+        if (c == '<' || c == '(') depth++;
+        else if ((c == '>' || c == ')') && depth > 0) depth--;
+        else if (depth == 0 && c == ':' && name[i + 1] == ':') last = i;
+    }
+    return last == std::string::npos ? name : name.substr(last + 2);
+}
+
+ProfileImporter::ProfileImporter(const CallGraph& graph) : graph_(graph) {
+    for (uint32_t node = 0; node < graph_.nodeCount(); node++) {
+        const std::string& name = graph_.name(node);
+        addKey(name, node);
+        addKey(withoutParameters(name), node);
+        addKey(withoutScope(withoutParameters(name)), node);
+    }
+}
+
+void ProfileImporter::addKey(const std::string& key, uint32_t node) {
+    auto it = byName_.emplace(key, node).first;
+    if (it->second != node) {
+        it->second = kAmbiguous;
+    }
+}
+
+bool ProfileImporter::import(const std::string& profilePath) {
+    std::ifstream file;
+    if (profilePath != "-") {
+        file.open(profilePath);
+        if (!file) {
+            std::cerr << "Can't open profile: " << profilePath << std::endl;
+            return false;
+        }
+    }
+    std::istream& in = profilePath == "-" ? std::cin : file;
+
+    // perf script indents its frame lines; collapsed stacks never are
+    std::string first;
+    while (std::getline(in, first) && first.empty()) {
+    }
+    std::string second;
+    std::getline(in, second);
+    bool perf = !second.empty() && (second[0] == ' ' || second[0] == '\t');
+
+    // Feed the two lines already consumed back in front of the stream
+    std::istringstream head(first + "\n" + second + "\n");
+    if (perf) {
+        importPerfScript(head);
+        importPerfScript(in);
+        flushSample(1, pendingWeight_);
+    } else {
+        importCollapsed(head);
+        importCollapsed(in);
+    }
+    return !in.bad();
+}
+
+void ProfileImporter::importPerfScript(std::istream& in) {
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            flushSample(1, pendingWeight_);
+            continue;
+        }
+
+        if (line[0] != ' ' && line[0] != '\t') {
+            // Header: the period follows "time:" when perf recorded one
+            flushSample(1, pendingWeight_);
+            pendingWeight_ = 1;
+            size_t colon = line.find(": ");
+            if (colon != std::string::npos) {
+                char* end;
+                long long period = std::strtoll(line.c_str() + colon + 2, &end, 10);
+                if (end != line.c_str() + colon + 2 && period > 0) {
+                    pendingWeight_ = period;
+                }
+            }
+            inSample_ = true;
+            continue;
+        }
+
+        // "\t  7f12ab3c ns::f(int)+0x1c (/usr/bin/app)"
+        size_t begin = line.find_first_not_of(" \t");
+        size_t symbol = line.find(' ', begin);
+        if (symbol == std::string::npos) {
+            continue;
+        }
+        symbol++;
+        size_t end = line.rfind(" (");
+        if (end == std::string::npos || end < symbol) {
+            end = line.size();
+        }
+        size_t offset = line.rfind("+0x", end);
+        if (offset != std::string::npos && offset > symbol) {
+            end = offset;
+        }
+        stack_.push_back(resolve(line.substr(symbol, end - symbol)));
+    }
+}
+
+void ProfileImporter::importCollapsed(std::istream& in) {
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t space = line.rfind(' ');
+        if (space == std::string::npos) {
+            continue;
+        }
+        long long count = std::strtoll(line.c_str() + space + 1, nullptr, 10);
+        if (count <= 0) {
+            continue;
+        }
+
+        // Root first in the file, leaf first on stack_
+        size_t begin = 0;
+        while (begin < space) {
+            size_t end = line.find(';', begin);
+            if (end == std::string::npos || end > space) {
+                end = space;
+            }
+            stack_.push_back(resolve(line.substr(begin, end - begin)));
+            begin = end + 1;
+        }
+        std::reverse(stack_.begin(), stack_.end());
+        inSample_ = true;
+        flushSample(count, count);
+    }
+}
+
+void ProfileImporter::flushSample(long long samples, long long weight) {
+    if (!inSample_) {
+        stack_.clear();
+        return;
+    }
+    inSample_ = false;
+
+    samples_ += samples;
+    frames_ += stack_.size();
+    seenEdges_.clear();
+    seenNodes_.clear();
+
+    for (size_t i = 0; i < stack_.size(); i++) {
+        uint32_t callee = stack_[i];
+        if (callee == CallGraph::kNone) {
+            unresolvedFrames_++;
+            continue;
+        }
+
+        // Recursion: each function and edge counts once per sample
+        if (std::find(seenNodes_.begin(), seenNodes_.end(), callee) == seenNodes_.end()) {
+            seenNodes_.push_back(callee);
+            FunctionTotals& totals = functions_[callee];
+            totals.total += weight;
+            if (i == 0) {
+                totals.self += weight;
+            }
+        }
+
+        if (i + 1 >= stack_.size() || stack_[i + 1] == CallGraph::kNone) {
+            continue;
+        }
+        uint64_t key = (static_cast<uint64_t>(stack_[i + 1]) << 32) | callee;
+        if (std::find(seenEdges_.begin(), seenEdges_.end(), key) != seenEdges_.end()) {
+            continue;
+        }
+        seenEdges_.push_back(key);
+        EdgeTotals& totals = edges_[key];
+        totals.samples += samples;
+        totals.inclusive += weight;
+        if (i == 0) {
+            totals.exclusive += weight;
+        }
+    }
+    stack_.clear();
+}
+
+uint32_t ProfileImporter::resolve(const std::string& symbol) {
+    auto cached = symbolCache_.find(symbol);
+    if (cached != symbolCache_.end()) {
+        return cached->second;
+    }
+
+    // Profilers print fully qualified signatures while the index stores
+    // declaration names, so try progressively looser keys: the symbol, then
+    // without its scope, then without parameters
+    uint32_t node = CallGraph::kNone;
+    const std::string candidates[] = {
+        symbol, withoutScope(symbol), withoutParameters(symbol),
+        withoutScope(withoutParameters(symbol))
+    };
+    for (const auto& key : candidates) {
+        auto it = byName_.find(key);
+        if (it != byName_.end() && it->second != kAmbiguous) {
+            node = it->second;
+            break;
+        }
+    }
+
+    symbolCache_.emplace(symbol, node);
+    return node;
+}
+
+bool ProfileImporter::save(const std::string& dbPath, bool replace) {
+    std::vector<ProjectDB::EdgeSamples> edges;
+    edges.reserve(edges_.size());
+    for (const auto& entry : edges_) {
+        uint32_t caller = static_cast<uint32_t>(entry.first >> 32);
+        uint32_t callee = static_cast<uint32_t>(entry.first);
+        edges.push_back({graph_.functionId(caller), graph_.functionId(callee),
+                         entry.second.samples, entry.second.inclusive, entry.second.exclusive});
+    }
+
+    std::vector<ProjectDB::FunctionSamples> functions;
+    functions.reserve(functions_.size());
+    for (const auto& entry : functions_) {
+        functions.push_back({graph_.functionId(entry.first), entry.second.self, entry.second.total});
+    }
+
+    // In primary key order, so the inserts append to the b-trees
+    std::sort(edges.begin(), edges.end(), [](const ProjectDB::EdgeSamples& a, const ProjectDB::EdgeSamples& b) {
+        return a.calleeId != b.calleeId ? a.calleeId < b.calleeId : a.callerId < b.callerId;
+    });
+    std::sort(functions.begin(), functions.end(),
+              [](const ProjectDB::FunctionSamples& a, const ProjectDB::FunctionSamples& b) {
+                  return a.functionId < b.functionId;
+              });
+
+    ProjectDB db(dbPath);
+    if (!db.initializeSchema()) {
+        std::cerr << "Failed to initialize database schema" << std::endl;
+        return false;
+    }
+    return db.storeProfile(edges, functions, replace);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CallGraph.h"
+
+// Streams sampled call stacks into per-edge and per-function weights.
+//
+// Accepted input, detected from the first lines:
+//   perf script   - a header line per sample ("comm pid [cpu] time: period
+//                   event:"), then one indented frame per line, leaf first,
+//                   and a blank line after each sample
+//   collapsed     - "root;caller;leaf count" per line (stackcollapse format)
+//
+// Samples are folded into the totals as they are read, so memory grows with
+// the number of distinct symbols and edges, not with the number of samples.
+// Frames that do not resolve to an indexed function break the stack: no edge
+// is attributed across them.
+class ProfileImporter {
+public:
+    explicit ProfileImporter(const CallGraph& graph);
+
+    // Reads a profile file, or standard input for "-"
+    bool import(const std::string& profilePath);
+
+    bool save(const std::string& dbPath, bool replace);
+
+    unsigned long long samples() const { return samples_; }
+    unsigned long long frames() const { return frames_; }
+    unsigned long long unresolvedFrames() const { return unresolvedFrames_; }
+
+private:
+    struct EdgeTotals {
+        long long samples = 0;
+        long long inclusive = 0;
+        long long exclusive = 0;
+    };
+
+    struct FunctionTotals {
+        long long self = 0;
+        long long total = 0;
+    };
+
+    const CallGraph& graph_;
+    // Lookup keys derived from the indexed names, see resolve()
+    std::unordered_map<std::string, uint32_t> byName_;
+    std::unordered_map<std::string, uint32_t> symbolCache_;
+    std::unordered_map<uint64_t, EdgeTotals> edges_;
+    std::unordered_map<uint32_t, FunctionTotals> functions_;
+    unsigned long long samples_ = 0;
+    unsigned long long frames_ = 0;
+    unsigned long long unresolvedFrames_ = 0;
+
+    // Sample being read, leaf first
+    std::vector<uint32_t> stack_;
+    bool inSample_ = false;
+    long long pendingWeight_ = 1;
+    std::vector<uint64_t> seenEdges_;
+    std::vector<uint32_t> seenNodes_;
+
+    void importPerfScript(std::istream& in);
+    void importCollapsed(std::istream& in);
+    // Folds stack_ into the totals as "samples" samples of total "weight"
+    void flushSample(long long samples, long long weight);
+    uint32_t resolve(const std::string& symbol);
+    void addKey(const std::string& key, uint32_t node);
+};
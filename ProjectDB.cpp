@@ -1,10 +1,13 @@
 #include "ProjectDB.h"
+#include <algorithm>
 #include <iostream>
 
 ProjectDB::ProjectDB(const std::string& dbPath) {
     if (sqlite3_open(dbPath.c_str(), &db_) != SQLITE_OK) {
         std::cerr << "Can't open database: " << sqlite3_errmsg(db_) << std::endl;
     }
+    // Several analyzer processes may write the same database
+    sqlite3_busy_timeout(db_, 60000);
 }
 
 ProjectDB::~ProjectDB() {
@@ -13,73 +16,521 @@ ProjectDB::~ProjectDB() {
     }
 }
 
+// Stored in PRAGMA user_version. Databases without it are v1: one BOOLEAN
+// column per call flag, no secondary indexes. v2 had no functions.usr, and
+// its qualified names lacked the enclosing scopes. v3 had no classes.usr, and
+// its calls could refer to any of the functions rows sharing a USR.
+static const int kSchemaVersion = 4;
+
+static const char* kSchemaSql = R"(
+    CREATE TABLE IF NOT EXISTS files (
+        id INTEGER PRIMARY KEY,
+        path TEXT NOT NULL UNIQUE
+    );
+
+    -- Every TU stores its own rows for the functions and classes it sees;
+    -- calls and bases refer to the lowest row id of a USR.
+    CREATE TABLE IF NOT EXISTS functions (
+        id INTEGER PRIMARY KEY,
+        name TEXT NOT NULL,
+        qualified_name TEXT NOT NULL,
+        return_type TEXT NOT NULL,
+        file_id INTEGER,
+        line INTEGER NOT NULL,
+        column INTEGER NOT NULL,
+        is_function_pointer BOOLEAN DEFAULT 0,
+        pointer_level INTEGER DEFAULT 0,
+        usr TEXT,
+        FOREIGN KEY (file_id) REFERENCES files(id)
+    );
+    CREATE INDEX IF NOT EXISTS functions_by_name ON functions (qualified_name);
+    CREATE INDEX IF NOT EXISTS functions_by_usr ON functions (usr);
+
+    CREATE TABLE IF NOT EXISTS classes (
+        id INTEGER PRIMARY KEY,
+        name TEXT NOT NULL,
+        qualified_name TEXT NOT NULL,
+        file_id INTEGER,
+        line INTEGER NOT NULL,
+        column INTEGER NOT NULL,
+        usr TEXT,
+        FOREIGN KEY (file_id) REFERENCES files(id)
+    );
+    CREATE INDEX IF NOT EXISTS classes_by_name ON classes (qualified_name);
+    CREATE INDEX IF NOT EXISTS classes_by_usr ON classes (usr);
+
+    CREATE TABLE IF NOT EXISTS inheritance (
+        derived_id INTEGER NOT NULL,
+        base_id INTEGER NOT NULL,
+        PRIMARY KEY (derived_id, base_id),
+        FOREIGN KEY (derived_id) REFERENCES classes(id),
+        FOREIGN KEY (base_id) REFERENCES classes(id)
+    ) WITHOUT ROWID;
+
+    CREATE TABLE IF NOT EXISTS templates (
+        id INTEGER PRIMARY KEY,
+        usr TEXT NOT NULL UNIQUE,
+        name TEXT NOT NULL,
+        file_id INTEGER,
+        line INTEGER NOT NULL,
+        FOREIGN KEY (file_id) REFERENCES files(id)
+    );
+
+    CREATE TABLE IF NOT EXISTS template_specializations (
+        id INTEGER PRIMARY KEY,
+        template_id INTEGER NOT NULL,
+        signature TEXT NOT NULL,
+        UNIQUE (template_id, signature),
+        FOREIGN KEY (template_id) REFERENCES templates(id)
+    );
+
+    -- flags is a ProjectDB::CallFlag bitmask. Calls keep their rowid because
+    -- call_contexts refers to it; the two indexes cover caller/callee lookups.
+    -- Keyed WITHOUT ROWID on (caller_id, callee_id, id), calls_by_caller could
+    -- go, but every new id would then need a table scan or an index of its own.
+    CREATE TABLE IF NOT EXISTS calls (
+        id INTEGER PRIMARY KEY,
+        caller_id INTEGER NOT NULL,
+        callee_id INTEGER NOT NULL,
+        call_file_id INTEGER,
+        call_line INTEGER NOT NULL,
+        call_column INTEGER NOT NULL,
+        flags INTEGER NOT NULL DEFAULT 0,
+        macro_definition_file_id INTEGER,
+        macro_definition_line INTEGER,
+        template_id INTEGER,
+        specialization_id INTEGER,
+        FOREIGN KEY (caller_id) REFERENCES functions(id),
+        FOREIGN KEY (callee_id) REFERENCES functions(id),
+        FOREIGN KEY (call_file_id) REFERENCES files(id),
+        FOREIGN KEY (macro_definition_file_id) REFERENCES files(id),
+        FOREIGN KEY (template_id) REFERENCES templates(id),
+        FOREIGN KEY (specialization_id) REFERENCES template_specializations(id)
+    );
+    CREATE INDEX IF NOT EXISTS calls_by_callee ON calls (callee_id, caller_id);
+    CREATE INDEX IF NOT EXISTS calls_by_caller ON calls (caller_id, callee_id);
+
+    CREATE TABLE IF NOT EXISTS tu_stats (
+        path TEXT PRIMARY KEY,
+        parse_ms INTEGER NOT NULL,
+        peak_rss_kb INTEGER NOT NULL,
+        status TEXT NOT NULL
+    ) WITHOUT ROWID;
+
+    CREATE TABLE IF NOT EXISTS call_contexts (
+        call_id INTEGER NOT NULL,
+        context_func_id INTEGER NOT NULL,
+        depth INTEGER NOT NULL,
+        PRIMARY KEY (call_id, context_func_id),
+        FOREIGN KEY (call_id) REFERENCES calls(id),
+        FOREIGN KEY (context_func_id) REFERENCES functions(id)
+    ) WITHOUT ROWID;
+
+    -- Runtime profile weights. Keyed by callee first for "who calls X hot"
+    -- lookups; ids are the functions rows that calls refer to.
+    CREATE TABLE IF NOT EXISTS edge_samples (
+        caller_id INTEGER NOT NULL,
+        callee_id INTEGER NOT NULL,
+        samples INTEGER NOT NULL,
+        inclusive_weight INTEGER NOT NULL,
+        exclusive_weight INTEGER NOT NULL,
+        PRIMARY KEY (callee_id, caller_id),
+        FOREIGN KEY (caller_id) REFERENCES functions(id),
+        FOREIGN KEY (callee_id) REFERENCES functions(id)
+    ) WITHOUT ROWID;
+
+    CREATE TABLE IF NOT EXISTS function_samples (
+        function_id INTEGER PRIMARY KEY,
+        self_weight INTEGER NOT NULL,
+        total_weight INTEGER NOT NULL,
+        FOREIGN KEY (function_id) REFERENCES functions(id)
+    );
+)";
+
 bool ProjectDB::initializeSchema() {
-    const char* sql = R"(
-        CREATE TABLE IF NOT EXISTS functions (
-            id INTEGER PRIMARY KEY,
-            name TEXT NOT NULL,
-            qualified_name TEXT NOT NULL,
-            return_type TEXT NOT NULL,
-            file_path TEXT NOT NULL,
-            line INTEGER NOT NULL,
-            column INTEGER NOT NULL,
-            is_function_pointer BOOLEAN DEFAULT 0,
-            pointer_level INTEGER DEFAULT 0
-        );
-
-        CREATE TABLE IF NOT EXISTS classes (
-            id INTEGER PRIMARY KEY,
-            name TEXT NOT NULL,
-            qualified_name TEXT NOT NULL,
-            file_path TEXT NOT NULL,
-            line INTEGER NOT NULL,
-            column INTEGER NOT NULL
-        );
-
-        CREATE TABLE IF NOT EXISTS inheritance (
-            derived_id INTEGER NOT NULL,
-            base_id INTEGER NOT NULL,
-            PRIMARY KEY (derived_id, base_id),
-            FOREIGN KEY (derived_id) REFERENCES classes(id),
-            FOREIGN KEY (base_id) REFERENCES classes(id)
-        );
-
-        CREATE TABLE IF NOT EXISTS calls (
-            id INTEGER PRIMARY KEY,
-            caller_id INTEGER NOT NULL,
-            callee_id INTEGER NOT NULL,
-            call_file TEXT NOT NULL,
-            call_line INTEGER NOT NULL,
-            call_column INTEGER NOT NULL,
-            is_virtual_call BOOLEAN DEFAULT 0,
-            is_template_instantiation BOOLEAN DEFAULT 0,
-            is_exception_path BOOLEAN DEFAULT 0,
-            is_macro_expansion BOOLEAN DEFAULT 0,
-            macro_definition_file TEXT,
-            macro_definition_line INTEGER,
-            is_dynamic_cast BOOLEAN DEFAULT 0,
-            FOREIGN KEY (caller_id) REFERENCES functions(id),
-            FOREIGN KEY (callee_id) REFERENCES functions(id)
-        );
-
-        CREATE TABLE IF NOT EXISTS call_contexts (
-            call_id INTEGER NOT NULL,
-            context_func_id INTEGER NOT NULL,
-            depth INTEGER NOT NULL,
-            PRIMARY KEY (call_id, context_func_id),
-            FOREIGN KEY (call_id) REFERENCES calls(id),
-            FOREIGN KEY (context_func_id) REFERENCES functions(id)
-        );
+    int version = schemaVersion();
+    if (version < 0) {
+        return false;
+    }
+    if (version > kSchemaVersion) {
+        std::cerr << "Database schema v" << version << " is newer than this analyzer supports" << std::endl;
+        return false;
+    }
+    if (version == 2) {
+        return migrateFromV2();
+    }
+    if (version == 3) {
+        return migrateFromV3();
+    }
+    if (version < kSchemaVersion && hasColumn("calls", "id")) {
+        return migrateFromV1();
+    }
+
+    return executeSQL(kSchemaSql) &&
+           (version == kSchemaVersion ||
+            executeSQL("PRAGMA user_version = " + std::to_string(kSchemaVersion)));
+}
+
+bool ProjectDB::hasCurrentSchema(const std::string& dbPath) {
+    sqlite3* db;
+    if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Can't open database: " << dbPath << ": " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_stmt* stmt;
+    int version = -1;
+    bool hasCalls = false;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    const char* tableSql = "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'calls'";
+    if (sqlite3_prepare_v2(db, tableSql, -1, &stmt, nullptr) == SQLITE_OK) {
+        hasCalls = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+    }
+    if (version < 0) {
+        std::cerr << "Can't read database: " << dbPath << ": " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_close(db);
+
+    if (version < 0) {
+        return false;
+    }
+    if (!hasCalls) {
+        std::cerr << dbPath << " is not a call graph database" << std::endl;
+        return false;
+    }
+    if (version > kSchemaVersion) {
+        std::cerr << dbPath << " has schema v" << version << ", newer than this analyzer supports" << std::endl;
+        return false;
+    }
+    if (version < kSchemaVersion) {
+        std::cerr << dbPath << " has schema v" << std::max(version, 1)
+                  << "; run \"callgraph_analyzer migrate " << dbPath << "\" to upgrade it to v"
+                  << kSchemaVersion << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int ProjectDB::schemaVersion() {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "PRAGMA user_version", -1, &stmt, nullptr) != SQLITE_OK) {
+        return -1;
+    }
+    int version = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+bool ProjectDB::hasColumn(const std::string& table, const std::string& column) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT 1 FROM pragma_table_info(?) WHERE name = ?";
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, table.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, column.c_str(), -1, SQLITE_TRANSIENT);
+    bool result = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+bool ProjectDB::migrateFromV1() {
+    if (!beginTransaction()) {
+        return false;
+    }
+    // Another process may have migrated while we waited for the lock
+    if (schemaVersion() == kSchemaVersion) {
+        return commitTransaction();
+    }
+    std::cerr << "Migrating database schema to v" << kSchemaVersion << std::endl;
+
+    // The first v1 databases stored paths as text on every row
+    bool textPaths = hasColumn("functions", "file_path");
+    bool hasTemplates = hasColumn("calls", "template_id");
+    bool hasTUStats = hasColumn("tu_stats", "path");
+    auto fileRef = [textPaths](const std::string& column) {
+        return textPaths ? "(SELECT id FROM files WHERE path = NULLIF(" + column + ", ''))" : column;
+    };
+
+    std::string sql = R"(
+        ALTER TABLE functions RENAME TO functions_v1;
+        ALTER TABLE classes RENAME TO classes_v1;
+        ALTER TABLE inheritance RENAME TO inheritance_v1;
+        ALTER TABLE calls RENAME TO calls_v1;
+        ALTER TABLE call_contexts RENAME TO call_contexts_v1;
     )";
+    if (hasTUStats) {
+        sql += "ALTER TABLE tu_stats RENAME TO tu_stats_v1;\n";
+    }
+    sql += kSchemaSql;
+
+    if (textPaths) {
+        sql += R"(
+            INSERT OR IGNORE INTO files (path)
+                SELECT file_path FROM functions_v1 WHERE file_path != ''
+                UNION SELECT file_path FROM classes_v1 WHERE file_path != ''
+                UNION SELECT call_file FROM calls_v1 WHERE call_file != ''
+                UNION SELECT macro_definition_file FROM calls_v1 WHERE macro_definition_file != '';
+        )";
+    }
+
+    sql += R"(
+        INSERT INTO functions (id, name, qualified_name, return_type, file_id, line, column,
+                               is_function_pointer, pointer_level)
+            SELECT id, name, qualified_name, return_type, )" + fileRef(textPaths ? "file_path" : "file_id") + R"(,
+                   line, column, is_function_pointer, pointer_level
+            FROM functions_v1;
+
+        INSERT INTO classes (id, name, qualified_name, file_id, line, column)
+            SELECT id, name, qualified_name, )" + fileRef(textPaths ? "file_path" : "file_id") + R"(,
+                   line, column
+            FROM classes_v1;
+
+        INSERT OR IGNORE INTO inheritance (derived_id, base_id)
+            SELECT derived_id, base_id FROM inheritance_v1;
+
+        INSERT INTO calls (id, caller_id, callee_id, call_file_id, call_line, call_column, flags,
+                           macro_definition_file_id, macro_definition_line,
+                           template_id, specialization_id)
+            SELECT id, caller_id, callee_id, )" + fileRef(textPaths ? "call_file" : "call_file_id") + R"(,
+                   call_line, call_column,
+                   (IFNULL(is_virtual_call, 0) != 0) * )" + std::to_string(CallVirtual) + R"(
+                   + (IFNULL(is_template_instantiation, 0) != 0) * )" + std::to_string(CallTemplateInstantiation) + R"(
+                   + (IFNULL(is_exception_path, 0) != 0) * )" + std::to_string(CallExceptionPath) + R"(
+                   + (IFNULL(is_macro_expansion, 0) != 0) * )" + std::to_string(CallMacroExpansion) + R"(
+                   + (IFNULL(is_dynamic_cast, 0) != 0) * )" + std::to_string(CallDynamicCast) + R"(,
+                   )" + fileRef(textPaths ? "macro_definition_file" : "macro_definition_file_id") + R"(,
+                   macro_definition_line,
+                   )" + (hasTemplates ? "template_id, specialization_id" : "NULL, NULL") + R"(
+            FROM calls_v1;
+
+        INSERT OR IGNORE INTO call_contexts (call_id, context_func_id, depth)
+            SELECT call_id, context_func_id, depth FROM call_contexts_v1;
+    )";
+    if (hasTUStats) {
+        sql += R"(
+            INSERT OR REPLACE INTO tu_stats (path, parse_ms, peak_rss_kb, status)
+                SELECT path, parse_ms, peak_rss_kb, status FROM tu_stats_v1;
+            DROP TABLE tu_stats_v1;
+        )";
+    }
+    sql += R"(
+        DROP TABLE call_contexts_v1;
+        DROP TABLE calls_v1;
+        DROP TABLE inheritance_v1;
+        DROP TABLE classes_v1;
+        DROP TABLE functions_v1;
+    )";
+    sql += "PRAGMA user_version = " + std::to_string(kSchemaVersion) + ";";
+
+    if (!executeSQL(sql)) {
+        rollbackTransaction();
+        return false;
+    }
+    if (!commitTransaction()) {
+        return false;
+    }
+    // Give the space of the dropped v1 tables back to the file system
+    return executeSQL("VACUUM");
+}
+
+// Adds classes.usr and points calls at the lowest functions row of their USR
+static const char* kV3ToV4Sql = R"(
+    ALTER TABLE classes ADD COLUMN usr TEXT;
+    CREATE INDEX classes_by_usr ON classes (usr);
+
+    CREATE TEMP TABLE function_map (old_id INTEGER PRIMARY KEY, new_id INTEGER NOT NULL);
+    INSERT INTO function_map
+        SELECT id, (SELECT MIN(m.id) FROM functions m WHERE m.usr = f.usr)
+        FROM functions f WHERE usr IS NOT NULL;
+    DELETE FROM function_map WHERE old_id = new_id;
+    UPDATE calls SET caller_id = (SELECT new_id FROM function_map WHERE old_id = caller_id)
+        WHERE caller_id IN (SELECT old_id FROM function_map);
+    UPDATE calls SET callee_id = (SELECT new_id FROM function_map WHERE old_id = callee_id)
+        WHERE callee_id IN (SELECT old_id FROM function_map);
+    UPDATE OR IGNORE call_contexts
+        SET context_func_id = (SELECT new_id FROM function_map WHERE old_id = context_func_id)
+        WHERE context_func_id IN (SELECT old_id FROM function_map);
+    DELETE FROM call_contexts WHERE context_func_id IN (SELECT old_id FROM function_map);
+    DROP TABLE temp.function_map;
+)";
+
+bool ProjectDB::migrateFromV2() {
+    if (!beginTransaction()) {
+        return false;
+    }
+    if (schemaVersion() == kSchemaVersion) {
+        return commitTransaction();
+    }
+    std::cerr << "Migrating database schema to v" << kSchemaVersion
+              << "; functions and classes indexed before have no USR until their TUs are indexed again"
+              << std::endl;
+
+    std::string sql = R"(
+        ALTER TABLE functions ADD COLUMN usr TEXT;
+        CREATE INDEX functions_by_usr ON functions (usr);
+    )";
+    sql += kV3ToV4Sql;
+    sql += "PRAGMA user_version = " + std::to_string(kSchemaVersion) + ";";
+    if (!executeSQL(sql)) {
+        rollbackTransaction();
+        return false;
+    }
+    return commitTransaction();
+}
+
+bool ProjectDB::migrateFromV3() {
+    if (!beginTransaction()) {
+        return false;
+    }
+    if (schemaVersion() == kSchemaVersion) {
+        return commitTransaction();
+    }
+    std::cerr << "Migrating database schema to v" << kSchemaVersion
+              << "; classes indexed before have no USR until their TUs are indexed again" << std::endl;
+
+    std::string sql = kV3ToV4Sql;
+    sql += "PRAGMA user_version = " + std::to_string(kSchemaVersion) + ";";
+    if (!executeSQL(sql)) {
+        rollbackTransaction();
+        return false;
+    }
+    return commitTransaction();
+}
+
+bool ProjectDB::beginTransaction() {
+    return executeSQL("BEGIN IMMEDIATE");
+}
+
+bool ProjectDB::commitTransaction() {
+    return executeSQL("COMMIT");
+}
+
+bool ProjectDB::rollbackTransaction() {
+    return executeSQL("ROLLBACK");
+}
+
+bool ProjectDB::storeFiles(const std::vector<std::string>& paths) {
+    const char* insertSql = "INSERT OR IGNORE INTO files (path) VALUES (?)";
+    const char* selectSql = "SELECT id FROM files WHERE path = ?";
+
+    sqlite3_stmt* insertStmt;
+    sqlite3_stmt* selectStmt;
+    if (sqlite3_prepare_v2(db_, insertSql, -1, &insertStmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    if (sqlite3_prepare_v2(db_, selectSql, -1, &selectStmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(insertStmt);
+        return false;
+    }
+
+    // Id 0 is the serializer's "no file" and stays NULL in the database
+    fileIds_.assign(1, 0);
+    bool result = true;
+    for (size_t i = 1; i < paths.size() && result; i++) {
+        sqlite3_bind_text(insertStmt, 1, paths[i].c_str(), -1, SQLITE_TRANSIENT);
+        result = sqlite3_step(insertStmt) == SQLITE_DONE;
+        sqlite3_reset(insertStmt);
+
+        sqlite3_bind_text(selectStmt, 1, paths[i].c_str(), -1, SQLITE_TRANSIENT);
+        result = result && sqlite3_step(selectStmt) == SQLITE_ROW;
+        if (result) {
+            fileIds_.push_back(sqlite3_column_int64(selectStmt, 0));
+        }
+        sqlite3_reset(selectStmt);
+    }
+
+    sqlite3_finalize(insertStmt);
+    sqlite3_finalize(selectStmt);
+    return result;
+}
+
+bool ProjectDB::storeTemplates(const std::vector<ASTSerializer::TemplateInfo>& templates,
+                               const std::vector<ASTSerializer::SpecializationInfo>& specializations) {
+    templateIds_.assign(1, 0);
+    specializationIds_.assign(1, 0);
+
+    for (const auto& tmpl : templates) {
+        sqlite3_stmt* stmt;
+        const char* insertSql = R"(
+            INSERT OR IGNORE INTO templates (usr, name, file_id, line) VALUES (?, ?, ?, ?)
+        )";
+        if (sqlite3_prepare_v2(db_, insertSql, -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, tmpl.usr.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, tmpl.name.c_str(), -1, SQLITE_TRANSIENT);
+        bindFileId(stmt, 3, tmpl.fileId);
+        sqlite3_bind_int(stmt, 4, tmpl.line);
+        bool result = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        if (!result) return false;
+
+        if (sqlite3_prepare_v2(db_, "SELECT id FROM templates WHERE usr = ?", -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, tmpl.usr.c_str(), -1, SQLITE_TRANSIENT);
+        result = sqlite3_step(stmt) == SQLITE_ROW;
+        if (result) {
+            templateIds_.push_back(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        if (!result) return false;
+    }
 
-    return executeSQL(sql);
+    for (const auto& spec : specializations) {
+        sqlite3_stmt* stmt;
+        const char* insertSql = R"(
+            INSERT OR IGNORE INTO template_specializations (template_id, signature) VALUES (?, ?)
+        )";
+        if (sqlite3_prepare_v2(db_, insertSql, -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        sqlite3_bind_int64(stmt, 1, templateIds_[spec.templateId]);
+        sqlite3_bind_text(stmt, 2, spec.signature.c_str(), -1, SQLITE_TRANSIENT);
+        bool result = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        if (!result) return false;
+
+        const char* selectSql = R"(
+            SELECT id FROM template_specializations WHERE template_id = ? AND signature = ?
+        )";
+        if (sqlite3_prepare_v2(db_, selectSql, -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        sqlite3_bind_int64(stmt, 1, templateIds_[spec.templateId]);
+        sqlite3_bind_text(stmt, 2, spec.signature.c_str(), -1, SQLITE_TRANSIENT);
+        result = sqlite3_step(stmt) == SQLITE_ROW;
+        if (result) {
+            specializationIds_.push_back(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        if (!result) return false;
+    }
+
+    return true;
+}
+
+void ProjectDB::bindFileId(sqlite3_stmt* stmt, int index, unsigned fileId) {
+    if (fileId == 0 || fileId >= fileIds_.size()) {
+        sqlite3_bind_null(stmt, index);
+    } else {
+        sqlite3_bind_int64(stmt, index, fileIds_[fileId]);
+    }
 }
 
 bool ProjectDB::storeFunction(const ASTSerializer::FunctionInfo& func) {
     std::string sql = R"(
-        INSERT INTO functions (name, qualified_name, return_type, file_path, line, column,
-                              is_function_pointer, pointer_level)
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+        INSERT INTO functions (name, qualified_name, return_type, file_id, line, column,
+                              is_function_pointer, pointer_level, usr)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, NULLIF(?, ''))
     )";
 
     sqlite3_stmt* stmt;
@@ -99,11 +550,12 @@ bool ProjectDB::storeFunction(const ASTSerializer::FunctionInfo& func) {
     sqlite3_bind_text(stmt, 1, func.name.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, func.qualifiedName.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, func.returnType.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 4, func.filePath.c_str(), -1, SQLITE_TRANSIENT);
+    bindFileId(stmt, 4, func.fileId);
     sqlite3_bind_int(stmt, 5, func.line);
     sqlite3_bind_int(stmt, 6, func.column);
     sqlite3_bind_int(stmt, 7, isFuncPtr ? 1 : 0);
     sqlite3_bind_int(stmt, 8, ptrLevel);
+    sqlite3_bind_text(stmt, 9, func.usr.c_str(), -1, SQLITE_TRANSIENT);
 
     bool result = sqlite3_step(stmt) == SQLITE_DONE;
     sqlite3_finalize(stmt);
@@ -111,22 +563,77 @@ bool ProjectDB::storeFunction(const ASTSerializer::FunctionInfo& func) {
 }
 
 bool ProjectDB::storeClass(const ASTSerializer::ClassInfo& cls) {
-    // Implementation...
+    std::string sql = R"(
+        INSERT INTO classes (name, qualified_name, file_id, line, column, usr)
+        VALUES (?, ?, ?, ?, ?, NULLIF(?, ''))
+    )";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, cls.name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, cls.qualifiedName.c_str(), -1, SQLITE_TRANSIENT);
+    bindFileId(stmt, 3, cls.fileId);
+    sqlite3_bind_int(stmt, 4, cls.line);
+    sqlite3_bind_int(stmt, 5, cls.column);
+    sqlite3_bind_text(stmt, 6, cls.usr.c_str(), -1, SQLITE_TRANSIENT);
+
+    bool result = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+
+    if (!result) return false;
+
+    sqlite3_int64 classId = sqlite3_last_insert_rowid(db_);
+
+    // Bases are declared before their derived classes, so they are already stored
+    for (const auto& base : cls.baseClasses) {
+        sql = R"(
+            INSERT OR IGNORE INTO inheritance (derived_id, base_id)
+            SELECT ?, id FROM classes WHERE usr = ? ORDER BY id LIMIT 1
+        )";
+
+        if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, classId);
+        sqlite3_bind_text(stmt, 2, base.c_str(), -1, SQLITE_TRANSIENT);
+
+        result = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+
+        if (!result) return false;
+    }
+
     return true;
 }
 
-bool ProjectDB::storeCallRelation(const ASTSerializer::CallInfo& call) {
+int ProjectDB::callFlags(const ASTSerializer::CallInfo& call) {
+    return (call.isVirtualCall ? CallVirtual : 0) |
+           (call.isTemplateInstantiation ? CallTemplateInstantiation : 0) |
+           (call.isExceptionPath ? CallExceptionPath : 0) |
+           (call.isMacroExpansion ? CallMacroExpansion : 0) |
+           (call.isDynamicCast ? CallDynamicCast : 0) |
+           (call.isAsyncSpawn ? CallAsyncSpawn : 0) |
+           (call.isStdFunctionCall ? CallStdFunction : 0) |
+           (call.isOperatorCall ? CallOperator : 0);
+}
+
+bool ProjectDB::storeCallRelation(const ASTSerializer::CallInfo& call, bool* stored) {
+    if (stored) {
+        *stored = false;
+    }
+
     // First insert the call record
     std::string sql = R"(
-        INSERT INTO calls (caller_id, callee_id, call_file, call_line, call_column,
-                          is_virtual_call, is_template_instantiation, is_exception_path,
-                          is_macro_expansion, macro_definition_file, macro_definition_line,
-                          is_dynamic_cast)
-        VALUES (
-            (SELECT id FROM functions WHERE qualified_name = ?),
-            (SELECT id FROM functions WHERE qualified_name = ?),
-            ?, ?, ?, ?, ?, ?, ?, ?, ?, ?
-        )
+        INSERT INTO calls (caller_id, callee_id, call_file_id, call_line, call_column, flags,
+                          macro_definition_file_id, macro_definition_line,
+                          template_id, specialization_id)
+        SELECT caller.id, callee.id, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10
+        FROM (SELECT id FROM functions WHERE usr = ?1 ORDER BY id LIMIT 1) AS caller,
+             (SELECT id FROM functions WHERE usr = ?2 ORDER BY id LIMIT 1) AS callee
     )";
 
     sqlite3_stmt* stmt;
@@ -134,24 +641,34 @@ bool ProjectDB::storeCallRelation(const ASTSerializer::CallInfo& call) {
         return false;
     }
 
-    sqlite3_bind_text(stmt, 1, call.caller.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, call.callee.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, call.filePath.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 1, call.callerUsr.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, call.calleeUsr.c_str(), -1, SQLITE_TRANSIENT);
+    bindFileId(stmt, 3, call.fileId);
     sqlite3_bind_int(stmt, 4, call.line);
     sqlite3_bind_int(stmt, 5, call.column);
-    sqlite3_bind_int(stmt, 6, call.isVirtualCall ? 1 : 0);
-    sqlite3_bind_int(stmt, 7, call.isTemplateInstantiation ? 1 : 0);
-    sqlite3_bind_int(stmt, 8, call.isExceptionPath ? 1 : 0);
-    sqlite3_bind_int(stmt, 9, call.isMacroExpansion ? 1 : 0);
-    sqlite3_bind_text(stmt, 10, call.macroDefinitionFile.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 11, call.macroDefinitionLine);
-    sqlite3_bind_int(stmt, 12, call.isDynamicCast ? 1 : 0);
+    sqlite3_bind_int(stmt, 6, callFlags(call));
+    bindFileId(stmt, 7, call.macroDefinitionFileId);
+    if (call.isMacroExpansion) {
+        sqlite3_bind_int(stmt, 8, call.macroDefinitionLine);
+    }
+    if (call.templateId != 0 && call.templateId < templateIds_.size()) {
+        sqlite3_bind_int64(stmt, 9, templateIds_[call.templateId]);
+    }
+    if (call.specializationId != 0 && call.specializationId < specializationIds_.size()) {
+        sqlite3_bind_int64(stmt, 10, specializationIds_[call.specializationId]);
+    }
 
     bool result = sqlite3_step(stmt) == SQLITE_DONE;
     sqlite3_finalize(stmt);
 
     if (!result) return false;
 
+    // Edges whose caller or callee is not an indexed function are skipped
+    if (sqlite3_changes(db_) == 0) return true;
+    if (stored) {
+        *stored = true;
+    }
+
     // Get the last inserted call ID
     sqlite3_int64 callId = sqlite3_last_insert_rowid(db_);
 
@@ -159,7 +676,7 @@ bool ProjectDB::storeCallRelation(const ASTSerializer::CallInfo& call) {
     for (size_t i = 0; i < call.contextStack.size(); i++) {
         sql = R"(
             INSERT INTO call_contexts (call_id, context_func_id, depth)
-            VALUES (?, (SELECT id FROM functions WHERE qualified_name = ?), ?)
+            VALUES (?, (SELECT id FROM functions WHERE usr = ? ORDER BY id LIMIT 1), ?)
         )";
 
         if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
@@ -179,6 +696,222 @@ bool ProjectDB::storeCallRelation(const ASTSerializer::CallInfo& call) {
     return true;
 }
 
+bool ProjectDB::loadTUStats(std::unordered_map<std::string, TUStats>& stats) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT path, parse_ms, peak_rss_kb, status FROM tu_stats";
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        TUStats entry;
+        entry.parseMs = sqlite3_column_int64(stmt, 1);
+        entry.peakRssKB = sqlite3_column_int64(stmt, 2);
+        entry.status = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        stats[reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))] = entry;
+    }
+
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+bool ProjectDB::storeTUStats(const std::string& path, const TUStats& stats) {
+    sqlite3_stmt* stmt;
+    const char* sql = R"(
+        INSERT OR REPLACE INTO tu_stats (path, parse_ms, peak_rss_kb, status)
+        VALUES (?, ?, ?, ?)
+    )";
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 2, stats.parseMs);
+    sqlite3_bind_int64(stmt, 3, stats.peakRssKB);
+    sqlite3_bind_text(stmt, 4, stats.status.c_str(), -1, SQLITE_TRANSIENT);
+
+    bool result = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+bool ProjectDB::storeProfile(const std::vector<EdgeSamples>& edges,
+                             const std::vector<FunctionSamples>& functions, bool replace) {
+    if (!beginTransaction()) {
+        return false;
+    }
+    if (replace && !executeSQL("DELETE FROM edge_samples; DELETE FROM function_samples;")) {
+        rollbackTransaction();
+        return false;
+    }
+
+    // Repeated imports add up
+    sqlite3_stmt* edgeStmt;
+    sqlite3_stmt* functionStmt;
+    const char* edgeSql = R"(
+        INSERT INTO edge_samples (caller_id, callee_id, samples, inclusive_weight, exclusive_weight)
+        VALUES (?, ?, ?, ?, ?)
+        ON CONFLICT (callee_id, caller_id) DO UPDATE SET
+            samples = samples + excluded.samples,
+            inclusive_weight = inclusive_weight + excluded.inclusive_weight,
+            exclusive_weight = exclusive_weight + excluded.exclusive_weight
+    )";
+    const char* functionSql = R"(
+        INSERT INTO function_samples (function_id, self_weight, total_weight) VALUES (?, ?, ?)
+        ON CONFLICT (function_id) DO UPDATE SET
+            self_weight = self_weight + excluded.self_weight,
+            total_weight = total_weight + excluded.total_weight
+    )";
+    if (sqlite3_prepare_v2(db_, edgeSql, -1, &edgeStmt, nullptr) != SQLITE_OK) {
+        rollbackTransaction();
+        return false;
+    }
+    if (sqlite3_prepare_v2(db_, functionSql, -1, &functionStmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(edgeStmt);
+        rollbackTransaction();
+        return false;
+    }
+
+    bool result = true;
+    for (size_t i = 0; i < edges.size() && result; i++) {
+        const EdgeSamples& edge = edges[i];
+        sqlite3_bind_int64(edgeStmt, 1, edge.callerId);
+        sqlite3_bind_int64(edgeStmt, 2, edge.calleeId);
+        sqlite3_bind_int64(edgeStmt, 3, edge.samples);
+        sqlite3_bind_int64(edgeStmt, 4, edge.inclusiveWeight);
+        sqlite3_bind_int64(edgeStmt, 5, edge.exclusiveWeight);
+        result = sqlite3_step(edgeStmt) == SQLITE_DONE;
+        sqlite3_reset(edgeStmt);
+    }
+    for (size_t i = 0; i < functions.size() && result; i++) {
+        const FunctionSamples& function = functions[i];
+        sqlite3_bind_int64(functionStmt, 1, function.functionId);
+        sqlite3_bind_int64(functionStmt, 2, function.selfWeight);
+        sqlite3_bind_int64(functionStmt, 3, function.totalWeight);
+        result = sqlite3_step(functionStmt) == SQLITE_DONE;
+        sqlite3_reset(functionStmt);
+    }
+    sqlite3_finalize(edgeStmt);
+    sqlite3_finalize(functionStmt);
+
+    if (!result) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db_) << std::endl;
+        rollbackTransaction();
+        return false;
+    }
+    return commitTransaction();
+}
+
+bool ProjectDB::mergeShard(const std::string& shardPath) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "ATTACH DATABASE ? AS shard", -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, shardPath.c_str(), -1, SQLITE_TRANSIENT);
+    bool result = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    if (!result) {
+        std::cerr << "SQL error: " << sqlite3_errmsg(db_) << std::endl;
+        return false;
+    }
+
+    // Shard rows are appended after the existing ids; files and templates are
+    // shared and matched by path / USR. Calls and bases are pointed at the
+    // lowest row of their USR, which may be an existing one.
+    const char* sql = R"(
+        BEGIN IMMEDIATE;
+
+        DROP TABLE IF EXISTS temp.merge_offsets;
+        CREATE TEMP TABLE merge_offsets AS SELECT
+            (SELECT IFNULL(MAX(id), 0) FROM main.functions) AS functions,
+            (SELECT IFNULL(MAX(id), 0) FROM main.classes) AS classes,
+            (SELECT IFNULL(MAX(id), 0) FROM main.calls) AS calls;
+
+        INSERT OR IGNORE INTO main.files (path) SELECT path FROM shard.files;
+        DROP TABLE IF EXISTS temp.file_map;
+        CREATE TEMP TABLE file_map AS
+            SELECT s.id AS old_id, m.id AS new_id
+            FROM shard.files s JOIN main.files m ON m.path = s.path;
+
+        INSERT INTO main.functions (id, name, qualified_name, return_type, file_id, line, column,
+                                    is_function_pointer, pointer_level, usr)
+            SELECT f.id + (SELECT functions FROM merge_offsets), f.name, f.qualified_name,
+                   f.return_type, fm.new_id, f.line, f.column, f.is_function_pointer, f.pointer_level,
+                   f.usr
+            FROM shard.functions f LEFT JOIN file_map fm ON fm.old_id = f.file_id;
+        DROP TABLE IF EXISTS temp.function_map;
+        CREATE TEMP TABLE function_map (old_id INTEGER PRIMARY KEY, new_id INTEGER NOT NULL);
+        INSERT INTO function_map
+            SELECT f.id, IFNULL((SELECT MIN(m.id) FROM main.functions m WHERE m.usr = f.usr),
+                                f.id + (SELECT functions FROM merge_offsets))
+            FROM shard.functions f;
+
+        INSERT INTO main.classes (id, name, qualified_name, file_id, line, column, usr)
+            SELECT c.id + (SELECT classes FROM merge_offsets), c.name, c.qualified_name,
+                   fm.new_id, c.line, c.column, c.usr
+            FROM shard.classes c LEFT JOIN file_map fm ON fm.old_id = c.file_id;
+        DROP TABLE IF EXISTS temp.class_map;
+        CREATE TEMP TABLE class_map (old_id INTEGER PRIMARY KEY, new_id INTEGER NOT NULL);
+        INSERT INTO class_map
+            SELECT c.id, IFNULL((SELECT MIN(m.id) FROM main.classes m WHERE m.usr = c.usr),
+                                c.id + (SELECT classes FROM merge_offsets))
+            FROM shard.classes c;
+
+        INSERT OR IGNORE INTO main.inheritance (derived_id, base_id)
+            SELECT i.derived_id + (SELECT classes FROM merge_offsets), cm.new_id
+            FROM shard.inheritance i JOIN class_map cm ON cm.old_id = i.base_id;
+
+        INSERT OR IGNORE INTO main.templates (usr, name, file_id, line)
+            SELECT t.usr, t.name, fm.new_id, t.line
+            FROM shard.templates t LEFT JOIN file_map fm ON fm.old_id = t.file_id;
+        DROP TABLE IF EXISTS temp.template_map;
+        CREATE TEMP TABLE template_map AS
+            SELECT s.id AS old_id, m.id AS new_id
+            FROM shard.templates s JOIN main.templates m ON m.usr = s.usr;
+
+        INSERT OR IGNORE INTO main.template_specializations (template_id, signature)
+            SELECT tm.new_id, s.signature
+            FROM shard.template_specializations s JOIN template_map tm ON tm.old_id = s.template_id;
+        DROP TABLE IF EXISTS temp.specialization_map;
+        CREATE TEMP TABLE specialization_map AS
+            SELECT s.id AS old_id, m.id AS new_id
+            FROM shard.template_specializations s
+            JOIN template_map tm ON tm.old_id = s.template_id
+            JOIN main.template_specializations m
+                ON m.template_id = tm.new_id AND m.signature = s.signature;
+
+        INSERT INTO main.calls (id, caller_id, callee_id, call_file_id, call_line, call_column,
+                                flags, macro_definition_file_id, macro_definition_line,
+                                template_id, specialization_id)
+            SELECT c.id + (SELECT calls FROM merge_offsets), caller.new_id, callee.new_id,
+                   cf.new_id, c.call_line, c.call_column,
+                   c.flags, mf.new_id, c.macro_definition_line, tm.new_id, sm.new_id
+            FROM shard.calls c
+            JOIN function_map caller ON caller.old_id = c.caller_id
+            JOIN function_map callee ON callee.old_id = c.callee_id
+            LEFT JOIN file_map cf ON cf.old_id = c.call_file_id
+            LEFT JOIN file_map mf ON mf.old_id = c.macro_definition_file_id
+            LEFT JOIN template_map tm ON tm.old_id = c.template_id
+            LEFT JOIN specialization_map sm ON sm.old_id = c.specialization_id;
+
+        INSERT OR IGNORE INTO main.call_contexts (call_id, context_func_id, depth)
+            SELECT cc.call_id + (SELECT calls FROM merge_offsets), fm.new_id, cc.depth
+            FROM shard.call_contexts cc JOIN function_map fm ON fm.old_id = cc.context_func_id;
+
+        INSERT OR REPLACE INTO main.tu_stats (path, parse_ms, peak_rss_kb, status)
+            SELECT path, parse_ms, peak_rss_kb, status FROM shard.tu_stats;
+
+        COMMIT;
+    )";
+
+    result = executeSQL(sql);
+    if (!result) {
+        sqlite3_exec(db_, "ROLLBACK", nullptr, nullptr, nullptr);
+    }
+    executeSQL("DETACH DATABASE shard");
+    return result;
+}
+
 bool ProjectDB::executeSQL(const std::string& sql) {
     char* errMsg = nullptr;
     if (sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
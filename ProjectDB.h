@@ -1,20 +1,90 @@
 #pragma once
 #include <sqlite3.h>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "ASTSerializer.h"
 
 class ProjectDB {
 public:
+    // Per-TU history used to schedule multi-TU runs
+    struct TUStats {
+        long long parseMs = 0;
+        long long peakRssKB = 0;   // peak above the worker RSS the TU started at
+        std::string status;
+    };
+
+    // Bits of calls.flags
+    enum CallFlag {
+        CallVirtual = 1 << 0,
+        CallTemplateInstantiation = 1 << 1,
+        CallExceptionPath = 1 << 2,
+        CallMacroExpansion = 1 << 3,
+        CallDynamicCast = 1 << 4,
+        CallAsyncSpawn = 1 << 5,
+        CallStdFunction = 1 << 6,
+        CallOperator = 1 << 7
+    };
+
+    // Imported profile weights of one caller -> callee edge
+    struct EdgeSamples {
+        sqlite3_int64 callerId;
+        sqlite3_int64 calleeId;
+        long long samples;          // sampled stacks containing the edge
+        long long inclusiveWeight;  // weight of those stacks
+        long long exclusiveWeight;  // weight of stacks where the callee was the leaf
+    };
+
+    struct FunctionSamples {
+        sqlite3_int64 functionId;
+        long long selfWeight;
+        long long totalWeight;
+    };
+
     ProjectDB(const std::string& dbPath);
     ~ProjectDB();
 
+    // Creates the schema, migrating databases written by older versions
     bool initializeSchema();
+    // For read-only commands: true if the database exists and has the
+    // current schema; never creates, migrates or writes it
+    static bool hasCurrentSchema(const std::string& dbPath);
+    bool beginTransaction();
+    bool commitTransaction();
+    bool rollbackTransaction();
+    // Maps the serializer's file ids to rows of the files table; must be
+    // called before storing rows that refer to those ids.
+    bool storeFiles(const std::vector<std::string>& paths);
+    // Same for the serializer's template and specialization ids
+    bool storeTemplates(const std::vector<ASTSerializer::TemplateInfo>& templates,
+                        const std::vector<ASTSerializer::SpecializationInfo>& specializations);
     bool storeFunction(const ASTSerializer::FunctionInfo& func);
     bool storeClass(const ASTSerializer::ClassInfo& cls); 
-    bool storeCallRelation(const ASTSerializer::CallInfo& call);
+    // stored is set to whether both ends resolved and a row was written
+    bool storeCallRelation(const ASTSerializer::CallInfo& call, bool* stored = nullptr);
+
+    bool loadTUStats(std::unordered_map<std::string, TUStats>& stats);
+    bool storeTUStats(const std::string& path, const TUStats& stats);
+
+    // Adds to the stored profile weights, or replaces them
+    bool storeProfile(const std::vector<EdgeSamples>& edges,
+                      const std::vector<FunctionSamples>& functions, bool replace);
+
+    // Appends another call graph database, remapping its row ids
+    bool mergeShard(const std::string& shardPath);
 
 private:
     sqlite3* db_;
+    std::vector<sqlite3_int64> fileIds_;
+    std::vector<sqlite3_int64> templateIds_;
+    std::vector<sqlite3_int64> specializationIds_;
 
     bool executeSQL(const std::string& sql);
+    int schemaVersion();
+    bool hasColumn(const std::string& table, const std::string& column);
+    bool migrateFromV1();
+    bool migrateFromV2();
+    bool migrateFromV3();
+    static int callFlags(const ASTSerializer::CallInfo& call);
+    void bindFileId(sqlite3_stmt* stmt, int index, unsigned fileId);
 };
@@ -0,0 +1,412 @@
+#include "ShardCoordinator.h"
+#include "ProjectDB.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+static bool makeDirectory(const std::string& path) {
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+static std::string processTag(pid_t pid = getpid()) {
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    return std::string(host) + "." + std::to_string(pid);
+}
+
+ShardCoordinator::ShardCoordinator(const std::string& workDir, unsigned staleSeconds)
+    : workDir_(workDir), staleSeconds_(staleSeconds) {}
+
+bool ShardCoordinator::createUnits(const std::vector<std::string>& sources, size_t unitSize,
+                                   const std::string& compileDbDir) {
+    if (!makeDirectory(workDir_) || !makeDirectory(workDir_ + "/units") ||
+        !makeDirectory(workDir_ + "/claims") || !makeDirectory(workDir_ + "/shards")) {
+        std::cerr << "Can't create work directory: " << workDir_ << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> existing = listUnits();
+    if (!existing.empty()) {
+        std::cerr << "Resuming " << existing.size() << " work units in " << workDir_ << std::endl;
+        return true;
+    }
+
+    {
+        std::ofstream manifest(workDir_ + "/manifest");
+        if (!compileDbDir.empty()) {
+            manifest << "compile_db=" << compileDbDir << "\n";
+        }
+        if (!manifest) {
+            return false;
+        }
+    }
+
+    if (unitSize == 0) {
+        unitSize = 1;
+    }
+    size_t unitCount = 0;
+    for (size_t begin = 0; begin < sources.size(); begin += unitSize) {
+        char name[32];
+        snprintf(name, sizeof(name), "unit-%05zu", unitCount++);
+
+        // Written aside and renamed so workers never see a partial unit
+        std::string tmpPath = unitPath(name) + ".tmp";
+        {
+            std::ofstream out(tmpPath);
+            for (size_t i = begin; i < std::min(begin + unitSize, sources.size()); i++) {
+                out << sources[i] << "\n";
+            }
+            if (!out) {
+                return false;
+            }
+        }
+        if (rename(tmpPath.c_str(), unitPath(name).c_str()) != 0) {
+            return false;
+        }
+    }
+
+    std::cerr << "Created " << unitCount << " work units for " << sources.size()
+              << " translation units in " << workDir_ << std::endl;
+    return true;
+}
+
+bool ShardCoordinator::runWorker(const UnitHandler& handler, const TUScheduler::Options& options) {
+    bool ok = true;
+    // Units that failed here are left for other workers instead of retried
+    std::set<std::string> attempted;
+    auto claimable = [this, &attempted](const std::string& unit) {
+        return !isDone(unit) && attempted.count(unit) == 0;
+    };
+
+    while (true) {
+        std::vector<std::string> units = listUnits();
+        std::string next;
+        for (const auto& unit : units) {
+            if (claimable(unit) && claim(unit)) {
+                next = unit;
+                break;
+            }
+        }
+        // Take over units whose owner stopped sending heartbeats
+        if (next.empty()) {
+            time_t now = fileSystemNow();
+            for (const auto& unit : units) {
+                if (claimable(unit) && stealStaleClaim(unit, now)) {
+                    next = unit;
+                    break;
+                }
+            }
+        }
+        if (next.empty()) {
+            break;
+        }
+
+        // Another worker may have finished it between the check and the claim
+        attempted.insert(next);
+        if (!isDone(next)) {
+            ok = processUnit(next, handler, options) && ok;
+        }
+        releaseClaim(next);
+    }
+    return ok;
+}
+
+bool ShardCoordinator::launchLocalWorkers(const std::vector<std::string>& command, unsigned count) {
+    std::vector<char*> argv;
+    for (const auto& arg : command) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    std::cout.flush();
+    std::cerr.flush();
+    for (unsigned i = 0; i < count; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Failed to start local worker" << std::endl;
+            return false;
+        }
+        if (pid == 0) {
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        localWorkers_.push_back(pid);
+    }
+    return true;
+}
+
+bool ShardCoordinator::waitForUnits(const UnitHandler& handler, const TUScheduler::Options& options) {
+    bool ok = true;
+    while (true) {
+        std::vector<std::string> units = listUnits();
+        if (std::all_of(units.begin(), units.end(),
+                        [this](const std::string& unit) { return isDone(unit); })) {
+            break;
+        }
+
+        for (size_t i = localWorkers_.size(); i-- > 0;) {
+            int status;
+            pid_t pid = localWorkers_[i];
+            if (waitpid(pid, &status, WNOHANG) == pid) {
+                localWorkers_.erase(localWorkers_.begin() + i);
+                // A crashed worker can't release its claims; don't leave its
+                // units waiting for the stale timeout
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    releaseClaimsOf(pid);
+                }
+            }
+        }
+
+        // No local workers left: index leftovers and stale units ourselves
+        if (localWorkers_.empty()) {
+            ok = runWorker(handler, options) && ok;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    for (pid_t pid : localWorkers_) {
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    localWorkers_.clear();
+    return ok;
+}
+
+bool ShardCoordinator::mergeShards(const std::string& outPath) {
+    // Merged aside so a rerun replaces the output instead of appending to it
+    std::string tmpPath = outPath + ".tmp." + processTag();
+    unlink(tmpPath.c_str());
+
+    size_t merged = 0;
+    std::vector<std::string> failed;
+    {
+        ProjectDB db(tmpPath);
+        if (!db.initializeSchema()) {
+            std::cerr << "Failed to initialize database schema" << std::endl;
+            return false;
+        }
+
+        for (const auto& unit : listUnits()) {
+            if (!isDone(unit)) {
+                std::cerr << "Missing shard for " << unit << std::endl;
+                unlink(tmpPath.c_str());
+                return false;
+            }
+            if (!db.mergeShard(shardPath(unit))) {
+                std::cerr << "Failed to merge shard " << shardPath(unit) << std::endl;
+                unlink(tmpPath.c_str());
+                return false;
+            }
+            merged++;
+        }
+
+        // Workers on every host record their failed TUs in the shards
+        std::unordered_map<std::string, ProjectDB::TUStats> stats;
+        if (!db.loadTUStats(stats)) {
+            std::cerr << "Failed to read translation unit status" << std::endl;
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        for (const auto& entry : stats) {
+            if (entry.second.status != "ok") {
+                failed.push_back(entry.first + " (" + entry.second.status + ")");
+            }
+        }
+    }
+
+    if (rename(tmpPath.c_str(), outPath.c_str()) != 0) {
+        std::cerr << "Can't write " << outPath << std::endl;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    std::cerr << "Merged " << merged << " shards into " << outPath << std::endl;
+
+    if (!failed.empty()) {
+        std::sort(failed.begin(), failed.end());
+        std::cerr << failed.size() << " translation units failed:" << std::endl;
+        for (const auto& path : failed) {
+            std::cerr << "  " << path << std::endl;
+        }
+    }
+    return failed.empty();
+}
+
+std::string ShardCoordinator::compileDbDir() const {
+    std::ifstream manifest(workDir_ + "/manifest");
+    std::string line;
+    const std::string key = "compile_db=";
+    while (std::getline(manifest, line)) {
+        if (line.compare(0, key.size(), key) == 0) {
+            return line.substr(key.size());
+        }
+    }
+    return "";
+}
+
+std::vector<std::string> ShardCoordinator::listUnits() const {
+    std::vector<std::string> units;
+    DIR* dir = opendir((workDir_ + "/units").c_str());
+    if (!dir) {
+        return units;
+    }
+
+    const std::string suffix = ".list";
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > suffix.size() &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            units.push_back(name.substr(0, name.size() - suffix.size()));
+        }
+    }
+    closedir(dir);
+
+    std::sort(units.begin(), units.end());
+    return units;
+}
+
+bool ShardCoordinator::isDone(const std::string& unit) const {
+    return access(shardPath(unit).c_str(), F_OK) == 0;
+}
+
+bool ShardCoordinator::claim(const std::string& unit) {
+    int fd = open(claimPath(unit).c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string owner = processTag() + "\n";
+    ssize_t written = write(fd, owner.data(), owner.size());
+    close(fd);
+    return written == static_cast<ssize_t>(owner.size());
+}
+
+void ShardCoordinator::releaseClaim(const std::string& unit) {
+    // A worker that missed its heartbeats may have lost the unit to another
+    // one; leave that worker's claim in place
+    std::ifstream in(claimPath(unit));
+    std::string owner;
+    if (std::getline(in, owner) && owner == processTag()) {
+        unlink(claimPath(unit).c_str());
+    }
+}
+
+void ShardCoordinator::releaseClaimsOf(pid_t pid) {
+    DIR* dir = opendir((workDir_ + "/claims").c_str());
+    if (!dir) {
+        return;
+    }
+    std::string owner = processTag(pid);
+    const std::string suffix = ".lock";
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() <= suffix.size() ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        std::string unit = name.substr(0, name.size() - suffix.size());
+        std::ifstream in(claimPath(unit));
+        std::string line;
+        if (std::getline(in, line) && line == owner) {
+            std::cerr << "Releasing work unit " << unit << " of exited worker " << pid << std::endl;
+            unlink(claimPath(unit).c_str());
+            unlink((shardPath(unit) + ".tmp." + owner).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+time_t ShardCoordinator::fileSystemNow() const {
+    // Heartbeats are stamped by the file system holding the claims, which may
+    // not agree with this host's clock; stamp a file there and read it back
+    std::string probePath = workDir_ + "/claims/.now." + processTag();
+    int fd = open(probePath.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        return time(nullptr);
+    }
+    struct stat st;
+    bool stamped = futimens(fd, nullptr) == 0 && fstat(fd, &st) == 0;
+    close(fd);
+    unlink(probePath.c_str());
+    return stamped ? st.st_mtime : time(nullptr);
+}
+
+bool ShardCoordinator::stealStaleClaim(const std::string& unit, time_t now) {
+    struct stat st;
+    if (stat(claimPath(unit).c_str(), &st) != 0 ||
+        now - st.st_mtime < static_cast<time_t>(staleSeconds_)) {
+        return false;
+    }
+
+    // rename is atomic, so only one worker wins the stale claim
+    std::string stalePath = claimPath(unit) + ".stale." + processTag();
+    if (rename(claimPath(unit).c_str(), stalePath.c_str()) != 0) {
+        return false;
+    }
+    // The owner may have sent a heartbeat between the stat and the rename;
+    // then the claim is live and goes back, unless someone claimed it since
+    if (stat(stalePath.c_str(), &st) == 0 && now - st.st_mtime < static_cast<time_t>(staleSeconds_)) {
+        link(stalePath.c_str(), claimPath(unit).c_str());
+        unlink(stalePath.c_str());
+        return false;
+    }
+    unlink(stalePath.c_str());
+
+    std::cerr << "Taking over stale work unit " << unit << std::endl;
+    return claim(unit);
+}
+
+bool ShardCoordinator::processUnit(const std::string& unit, const UnitHandler& handler,
+                                   const TUScheduler::Options& options) {
+    std::vector<std::string> sources;
+    {
+        std::ifstream in(unitPath(unit));
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty()) {
+                sources.push_back(line);
+            }
+        }
+    }
+
+    // Built under a private name; the rename publishes the finished shard
+    std::string tmpPath = shardPath(unit) + ".tmp." + processTag();
+    unlink(tmpPath.c_str());
+
+    std::string claimFile = claimPath(unit);
+    auto lastBeat = std::chrono::steady_clock::now();
+    auto heartbeatInterval = std::chrono::seconds(std::max(1u, std::min(30u, staleSeconds_ / 4)));
+
+    TUScheduler scheduler(tmpPath, options);
+    scheduler.setTickHandler([&]() {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastBeat >= heartbeatInterval) {
+            utimensat(AT_FDCWD, claimFile.c_str(), nullptr, 0);
+            lastBeat = now;
+        }
+    });
+    bool ok = scheduler.run(sources, [&handler, &tmpPath](const std::string& sourceFile) {
+        return handler(sourceFile, tmpPath);
+    });
+
+    // Failed TUs are recorded in the shard's tu_stats, which mergeShards
+    // reports; the rest of the shard is still usable
+    if (rename(tmpPath.c_str(), shardPath(unit).c_str()) != 0) {
+        std::cerr << "Failed to publish shard for " << unit << std::endl;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    std::cerr << "Finished work unit " << unit << std::endl;
+    return ok;
+}
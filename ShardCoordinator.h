@@ -0,0 +1,70 @@
+#pragma once
+#include <sys/types.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "TUScheduler.h"
+
+// File-based coordination of indexing across processes and hosts.
+//
+// The coordinator splits the TUs into work units inside a shared work
+// directory:
+//   manifest                 key/value settings (compile_db)
+//   units/unit-NNNNN.list    one source file per line
+//   claims/unit-NNNNN.lock   created with O_EXCL by the worker that owns it
+//   shards/unit-NNNNN.db     finished shard, renamed into place atomically
+//
+// Workers on any host sharing the directory claim units, index them into a
+// shard database and touch their claim as a heartbeat. Claims whose heartbeat
+// is older than the stale timeout, measured on the work directory's file
+// system clock, are taken over; the coordinator releases the claims of its
+// own local workers as soon as one of them dies. Once every unit has a shard,
+// the coordinator merges the shards into the final database.
+class ShardCoordinator {
+public:
+    // Indexes one TU into the given shard database
+    using UnitHandler = std::function<bool(const std::string& sourceFile, const std::string& dbPath)>;
+
+    ShardCoordinator(const std::string& workDir, unsigned staleSeconds = 600);
+
+    // Writes the work units unless the directory already has some (resume)
+    bool createUnits(const std::vector<std::string>& sources, size_t unitSize,
+                     const std::string& compileDbDir);
+
+    // Claims and indexes units until none are left to claim
+    bool runWorker(const UnitHandler& handler, const TUScheduler::Options& options);
+
+    // Starts worker processes executing the given command line, which is
+    // expected to run runWorker on the same work directory
+    bool launchLocalWorkers(const std::vector<std::string>& command, unsigned count);
+
+    // Waits until every unit has a shard, indexing leftovers itself if the
+    // local workers are gone. Returns false if any TU it indexed failed.
+    bool waitForUnits(const UnitHandler& handler, const TUScheduler::Options& options);
+
+    // Returns false if a shard is missing, or if any TU of any shard failed;
+    // in the latter case the merged database is still written
+    bool mergeShards(const std::string& outPath);
+
+    std::string compileDbDir() const;
+
+private:
+    std::string workDir_;
+    unsigned staleSeconds_;
+    std::vector<pid_t> localWorkers_;
+
+    std::vector<std::string> listUnits() const;
+    bool isDone(const std::string& unit) const;
+    bool claim(const std::string& unit);
+    void releaseClaim(const std::string& unit);
+    // Drops the claims of a local worker that exited without releasing them
+    void releaseClaimsOf(pid_t pid);
+    time_t fileSystemNow() const;
+    bool stealStaleClaim(const std::string& unit, time_t now);
+    bool processUnit(const std::string& unit, const UnitHandler& handler,
+                     const TUScheduler::Options& options);
+
+    std::string unitPath(const std::string& unit) const { return workDir_ + "/units/" + unit + ".list"; }
+    std::string claimPath(const std::string& unit) const { return workDir_ + "/claims/" + unit + ".lock"; }
+    std::string shardPath(const std::string& unit) const { return workDir_ + "/shards/" + unit + ".db"; }
+};
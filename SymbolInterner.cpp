@@ -0,0 +1,156 @@
+#include "SymbolInterner.h"
+#include <cstring>
+
+static const size_t kInitialCapacity = 64;
+static const size_t kArenaBlockSize = 64 * 1024;
+
+SymbolInterner::Table::Table(size_t capacity)
+    : mask(capacity - 1), slots(new std::atomic<uint64_t>[capacity]) {
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+SymbolInterner::SymbolInterner(unsigned shardBits)
+    : shardBits_(shardBits),
+      shards_(new Shard[size_t(1) << shardBits]),
+      chunks_(new std::atomic<Entry*>[kMaxChunks]) {
+    for (size_t i = 0; i < (size_t(1) << shardBits_); i++) {
+        shards_[i].tables.emplace_back(new Table(kInitialCapacity));
+        shards_[i].table.store(shards_[i].tables.back().get(), std::memory_order_release);
+    }
+    for (size_t i = 0; i < kMaxChunks; i++) {
+        chunks_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+SymbolInterner::~SymbolInterner() {
+    for (size_t i = 0; i < kMaxChunks; i++) {
+        delete[] chunks_[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint32_t SymbolInterner::intern(const char* data, size_t size) {
+    uint64_t h = hash(data, size);
+    Shard& shard = shardFor(h);
+
+    uint32_t id = probe(shard.table.load(std::memory_order_acquire), h, data, size);
+    if (id != 0) {
+        return id;
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // Another thread may have inserted it while we waited
+    Table* table = shard.table.load(std::memory_order_relaxed);
+    id = probe(table, h, data, size);
+    if (id != 0) {
+        return id;
+    }
+
+    if ((shard.count + 1) * 2 > table->mask + 1) {
+        grow(shard);
+        table = shard.table.load(std::memory_order_relaxed);
+    }
+
+    id = nextId_.fetch_add(1, std::memory_order_relaxed);
+    // The name must be visible before the slot that leads readers to it
+    publish(id, copyToArena(shard, data, size), size);
+    insertSlot(table, h, id);
+    shard.count++;
+    return id;
+}
+
+uint32_t SymbolInterner::find(const char* data, size_t size) const {
+    uint64_t h = hash(data, size);
+    return probe(shardFor(h).table.load(std::memory_order_acquire), h, data, size);
+}
+
+std::string SymbolInterner::name(uint32_t id) const {
+    const Entry& e = entry(id);
+    return std::string(e.data, e.size);
+}
+
+uint64_t SymbolInterner::hash(const char* data, size_t size) {
+    // FNV-1a followed by a murmur finalizer to spread the low (shard) bits
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint32_t SymbolInterner::probe(const Table* table, uint64_t h, const char* data, size_t size) const {
+    // The high 32 bits are stored as a tag so most mismatches skip the compare
+    uint64_t tag = h >> 32;
+    for (size_t i = (h >> shardBits_) & table->mask;; i = (i + 1) & table->mask) {
+        uint64_t slot = table->slots[i].load(std::memory_order_acquire);
+        if (slot == 0) {
+            return 0;
+        }
+        if ((slot >> 32) == tag) {
+            uint32_t id = static_cast<uint32_t>(slot);
+            const Entry& e = entry(id);
+            if (e.size == size && std::memcmp(e.data, data, size) == 0) {
+                return id;
+            }
+        }
+    }
+}
+
+void SymbolInterner::insertSlot(Table* table, uint64_t h, uint32_t id) {
+    size_t i = (h >> shardBits_) & table->mask;
+    while (table->slots[i].load(std::memory_order_relaxed) != 0) {
+        i = (i + 1) & table->mask;
+    }
+    table->slots[i].store(((h >> 32) << 32) | id, std::memory_order_release);
+}
+
+void SymbolInterner::grow(Shard& shard) {
+    Table* old = shard.table.load(std::memory_order_relaxed);
+    std::unique_ptr<Table> table(new Table((old->mask + 1) * 2));
+
+    for (size_t i = 0; i <= old->mask; i++) {
+        uint64_t slot = old->slots[i].load(std::memory_order_relaxed);
+        if (slot != 0) {
+            const Entry& e = entry(static_cast<uint32_t>(slot));
+            insertSlot(table.get(), hash(e.data, e.size), static_cast<uint32_t>(slot));
+        }
+    }
+
+    // Readers switch over on their next lookup; the old table is kept for any
+    // lookup still in flight
+    shard.table.store(table.get(), std::memory_order_release);
+    shard.tables.push_back(std::move(table));
+}
+
+const char* SymbolInterner::copyToArena(Shard& shard, const char* data, size_t size) {
+    if (shard.arena.empty() || shard.arenaUsed + size > shard.arenaCapacity) {
+        size_t capacity = size > kArenaBlockSize ? size : kArenaBlockSize;
+        shard.arena.emplace_back(new char[capacity]);
+        shard.arenaUsed = 0;
+        shard.arenaCapacity = capacity;
+    }
+    char* dest = shard.arena.back().get() + shard.arenaUsed;
+    std::memcpy(dest, data, size);
+    shard.arenaUsed += size;
+    return dest;
+}
+
+void SymbolInterner::publish(uint32_t id, const char* data, size_t size) {
+    std::atomic<Entry*>& chunk = chunks_[id >> kChunkBits];
+    Entry* entries = chunk.load(std::memory_order_acquire);
+    if (!entries) {
+        // Threads of different shards may race to allocate the same chunk
+        Entry* fresh = new Entry[kChunkSize]();
+        if (chunk.compare_exchange_strong(entries, fresh, std::memory_order_acq_rel)) {
+            entries = fresh;
+        } else {
+            delete[] fresh;
+        }
+    }
+    entries[id & (kChunkSize - 1)] = Entry{data, static_cast<uint32_t>(size)};
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Maps symbol names (qualified names, USRs) to dense global ids, safe to use
+// from many threads at once.
+//
+// The table is split into shards by hash. Each shard is an open-addressing
+// array of 64-bit slots holding (hash tag << 32 | id), so a lookup of a known
+// symbol is a handful of atomic loads and one string compare and never takes
+// a lock. Inserts take the shard's mutex only. Strings live in an append-only
+// arena and never move, so returned names stay valid for the interner's
+// lifetime. Ids start at 1; 0 means "not interned".
+class SymbolInterner {
+public:
+    explicit SymbolInterner(unsigned shardBits = 6);
+    ~SymbolInterner();
+
+    SymbolInterner(const SymbolInterner&) = delete;
+    SymbolInterner& operator=(const SymbolInterner&) = delete;
+
+    // Returns the id of the symbol, assigning the next free one on first use
+    uint32_t intern(const char* data, size_t size);
+    uint32_t intern(const std::string& symbol) { return intern(symbol.data(), symbol.size()); }
+
+    // Wait-free; returns 0 for unknown symbols
+    uint32_t find(const char* data, size_t size) const;
+    uint32_t find(const std::string& symbol) const { return find(symbol.data(), symbol.size()); }
+
+    // Name of an id returned by intern()
+    std::string name(uint32_t id) const;
+    const char* data(uint32_t id) const { return entry(id).data; }
+    size_t length(uint32_t id) const { return entry(id).size; }
+
+    size_t size() const { return nextId_.load(std::memory_order_acquire) - 1; }
+
+private:
+    struct Entry {
+        const char* data;
+        uint32_t size;
+    };
+
+    struct Table {
+        explicit Table(size_t capacity);
+        size_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::atomic<Table*> table{nullptr};
+        size_t count = 0;
+        // Replaced tables stay alive for readers still probing them
+        std::vector<std::unique_ptr<Table>> tables;
+        std::vector<std::unique_ptr<char[]>> arena;
+        size_t arenaUsed = 0;
+        size_t arenaCapacity = 0;
+    };
+
+    // Id directory: fixed array of lazily allocated chunks, so entries never move
+    static constexpr unsigned kChunkBits = 14;
+    static constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+    static constexpr size_t kMaxChunks = size_t(1) << 18;
+
+    unsigned shardBits_;
+    std::unique_ptr<Shard[]> shards_;
+    std::unique_ptr<std::atomic<Entry*>[]> chunks_;
+    std::atomic<uint32_t> nextId_{1};
+
+    static uint64_t hash(const char* data, size_t size);
+    Shard& shardFor(uint64_t h) const { return shards_[h & ((size_t(1) << shardBits_) - 1)]; }
+
+    uint32_t probe(const Table* table, uint64_t h, const char* data, size_t size) const;
+    void insertSlot(Table* table, uint64_t h, uint32_t id);
+    void grow(Shard& shard);
+    const char* copyToArena(Shard& shard, const char* data, size_t size);
+    void publish(uint32_t id, const char* data, size_t size);
+    const Entry& entry(uint32_t id) const {
+        return chunks_[id >> kChunkBits].load(std::memory_order_acquire)[id & (kChunkSize - 1)];
+    }
+};
@@ -0,0 +1,146 @@
+// Microbenchmark for SymbolInterner: interning throughput by thread count,
+// against a mutex-protected unordered_map as the baseline.
+//
+// Usage: symbol_interner_bench [max-threads] [symbols] [ops-per-thread]
+//
+// Every thread interns a random mix drawn from the same symbol set, so the
+// early operations insert and the rest are lookups of known symbols, as when
+// many TUs include the same headers.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "SymbolInterner.h"
+
+class MutexInterner {
+public:
+    uint32_t intern(const std::string& symbol) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = ids_.find(symbol);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(ids_.size() + 1);
+        ids_.emplace(symbol, id);
+        return id;
+    }
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, uint32_t> ids_;
+};
+
+static std::vector<std::string> makeSymbols(size_t count) {
+    std::vector<std::string> symbols;
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < count; i++) {
+        symbols.push_back("c:@N@project@N@module" + std::to_string(rng() % 64) + "@S@Class" +
+                          std::to_string(i) + "@F@method" + std::to_string(rng() % 1000) + "#I#");
+    }
+    return symbols;
+}
+
+template <typename Interner>
+static double run(Interner& interner, const std::vector<std::string>& symbols,
+                  unsigned threads, size_t opsPerThread) {
+    std::vector<std::vector<uint32_t>> orders(threads);
+    for (unsigned t = 0; t < threads; t++) {
+        std::mt19937 rng(t + 1);
+        std::uniform_int_distribution<uint32_t> pick(0, static_cast<uint32_t>(symbols.size() - 1));
+        for (size_t i = 0; i < opsPerThread; i++) {
+            orders[t].push_back(pick(rng));
+        }
+    }
+
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&interner, &symbols, &orders, t]() {
+            uint64_t checksum = 0;
+            for (uint32_t index : orders[t]) {
+                checksum += interner.intern(symbols[index]);
+            }
+            if (checksum == 0) {
+                std::cerr << "unexpected checksum" << std::endl;
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return threads * opsPerThread / seconds / 1e6;
+}
+
+static bool verify(const std::vector<std::string>& symbols, unsigned threads) {
+    SymbolInterner interner;
+    std::vector<std::vector<uint32_t>> ids(threads, std::vector<uint32_t>(symbols.size()));
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (size_t i = 0; i < symbols.size(); i++) {
+                size_t index = (i * 7919 + t * 104729) % symbols.size();
+                ids[t][index] = interner.intern(symbols[index]);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Every thread must have seen the same id, and the id must map back
+    if (interner.size() != symbols.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < symbols.size(); i++) {
+        for (unsigned t = 1; t < threads; t++) {
+            if (ids[t][i] != ids[0][i]) {
+                return false;
+            }
+        }
+        if (interner.name(ids[0][i]) != symbols[i] || interner.find(symbols[i]) != ids[0][i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    unsigned maxThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    size_t symbolCount = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200000;
+    size_t opsPerThread = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1000000;
+
+    std::vector<std::string> symbols = makeSymbols(symbolCount);
+    if (!verify(symbols, std::min(maxThreads, 8u))) {
+        std::cerr << "SymbolInterner returned inconsistent ids" << std::endl;
+        return 1;
+    }
+
+    // Rows with more threads than cores time-slice and say nothing about scaling
+    unsigned cores = std::thread::hardware_concurrency();
+    printf("hardware threads: %u\n", cores);
+    printf("threads  sharded Mops/s  speedup  mutex Mops/s  speedup\n");
+    double shardedBase = 0;
+    double mutexBase = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        SymbolInterner sharded;
+        MutexInterner locked;
+        double shardedRate = run(sharded, symbols, threads, opsPerThread);
+        double mutexRate = run(locked, symbols, threads, opsPerThread);
+        if (threads == 1) {
+            shardedBase = shardedRate;
+            mutexBase = mutexRate;
+        }
+        printf("%7u  %14.1f  %7.2f  %12.1f  %7.2f%s\n", threads, shardedRate, shardedRate / shardedBase,
+               mutexRate, mutexRate / mutexBase, cores != 0 && threads > cores ? "  (oversubscribed)" : "");
+    }
+    return 0;
+}
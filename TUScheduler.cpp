@@ -0,0 +1,417 @@
+#include "TUScheduler.h"
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+TUScheduler::TUScheduler(const std::string& dbPath, const Options& options)
+    : dbPath_(dbPath), options_(options) {
+    if (options_.workers == 0) {
+        options_.workers = 1;
+    }
+}
+
+bool TUScheduler::run(const std::vector<std::string>& sources, const TUHandler& handler) {
+    // A worker dying mid-write must not kill the scheduler
+    signal(SIGPIPE, SIG_IGN);
+
+    orderTasks(sources);
+    failed_.clear();
+
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < tasks_.size(); i++) {
+        pending.push_back(i);
+    }
+
+    auto busyCount = [this]() {
+        return static_cast<size_t>(std::count_if(workers_.begin(), workers_.end(),
+                                   [](const Worker& w) { return w.currentTask >= 0; }));
+    };
+
+    while (!pending.empty() || busyCount() > 0) {
+        if (tick_) {
+            tick_();
+        }
+
+        // Idle workers hold on to libclang memory; drop them when over budget
+        if (options_.memoryBudgetMB > 0 &&
+            committedRssKB() > static_cast<long long>(options_.memoryBudgetMB) * 1024) {
+            for (size_t i = workers_.size(); i-- > 0;) {
+                if (workers_[i].currentTask < 0 && workers_[i].tusDone > 0) {
+                    retireWorker(i);
+                }
+            }
+        }
+
+        // Keep the pool full while work remains
+        while (workers_.size() < options_.workers &&
+               workers_.size() - busyCount() < pending.size()) {
+            if (!spawnWorker(handler)) {
+                if (workers_.empty()) {
+                    return false;
+                }
+                break;
+            }
+        }
+
+        for (auto& worker : workers_) {
+            if (worker.currentTask < 0 && !pending.empty()) {
+                dispatch(worker, pending);
+            }
+        }
+
+        std::vector<pollfd> fds;
+        for (const auto& worker : workers_) {
+            fds.push_back({worker.resultFd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), 1000) < 0) {
+            continue;
+        }
+
+        for (size_t i = workers_.size(); i-- > 0;) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            if (!readResults(workers_[i]) || workers_[i].retiring) {
+                retireWorker(i);
+            }
+        }
+    }
+
+    // Shut down the remaining workers
+    while (!workers_.empty()) {
+        retireWorker(workers_.size() - 1);
+    }
+
+    if (!failed_.empty()) {
+        std::cerr << failed_.size() << " of " << tasks_.size() << " translation units failed:" << std::endl;
+        for (const auto& path : failed_) {
+            std::cerr << "  " << path << std::endl;
+        }
+    }
+    return failed_.empty();
+}
+
+void TUScheduler::orderTasks(const std::vector<std::string>& sources) {
+    std::unordered_map<std::string, ProjectDB::TUStats> stats;
+    {
+        ProjectDB db(dbPath_);
+        if (db.initializeSchema()) {
+            db.loadTUStats(stats);
+        }
+    }
+
+    tasks_.clear();
+    for (const auto& path : sources) {
+        Task task{path, 0, 0};
+        auto it = stats.find(path);
+        if (it != stats.end()) {
+            task.estimatedMs = it->second.parseMs;
+            task.estimatedRssKB = it->second.peakRssKB;
+        } else {
+            task.estimatedMs = estimateCostMs(path);
+        }
+        tasks_.push_back(task);
+    }
+
+    // Longest first, so giant TUs do not start last and dominate the tail
+    std::stable_sort(tasks_.begin(), tasks_.end(), [](const Task& a, const Task& b) {
+        return a.estimatedMs > b.estimatedMs;
+    });
+}
+
+bool TUScheduler::spawnWorker(const TUHandler& handler) {
+    int taskPipe[2];
+    int resultPipe[2];
+    if (pipe(taskPipe) != 0) {
+        return false;
+    }
+    if (pipe(resultPipe) != 0) {
+        close(taskPipe[0]);
+        close(taskPipe[1]);
+        return false;
+    }
+
+    // Buffered output would otherwise be written by both processes
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(taskPipe[0]);
+        close(taskPipe[1]);
+        close(resultPipe[0]);
+        close(resultPipe[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        // An orphaned worker would keep writing a shard its claim no longer covers
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent) {
+            _exit(1);
+        }
+        close(taskPipe[1]);
+        close(resultPipe[0]);
+        // Other workers must see EOF when the scheduler closes their pipes
+        for (const auto& worker : workers_) {
+            close(worker.taskFd);
+            close(worker.resultFd);
+        }
+        runWorker(taskPipe[0], resultPipe[1], handler);
+        _exit(0);
+    }
+
+    close(taskPipe[0]);
+    close(resultPipe[1]);
+
+    Worker worker;
+    worker.pid = pid;
+    worker.taskFd = taskPipe[1];
+    worker.resultFd = resultPipe[0];
+    workers_.push_back(worker);
+    return true;
+}
+
+void TUScheduler::runWorker(int taskFd, int resultFd, const TUHandler& handler) {
+    FILE* in = fdopen(taskFd, "r");
+    if (!in) {
+        return;
+    }
+
+    unsigned tusDone = 0;
+    char line[64];
+    while (fgets(line, sizeof(line), in)) {
+        size_t index = std::strtoul(line, nullptr, 10);
+        if (index >= tasks_.size()) {
+            break;
+        }
+
+        // ru_maxrss spans the worker's lifetime; reset the high-water mark so
+        // it covers this TU only. The TU's cost is its growth above the RSS it
+        // started from, which the budget adds to the workers' current RSS.
+        bool peakReset = resetPeakRss();
+        long long rssBeforeKB = currentRssKB(getpid());
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = handler(tasks_[index].path);
+        long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        std::cout.flush();
+        std::cerr.flush();
+
+        long long rssKB = currentRssKB(getpid());
+        long long peakKB;
+        if (peakReset) {
+            peakKB = peakRssKB();
+        } else if (tusDone == 0) {
+            // Nothing ran in this process before the first TU
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            peakKB = usage.ru_maxrss;
+        } else {
+            peakKB = std::max(rssBeforeKB, rssKB);
+        }
+        peakKB = std::max(peakKB - rssBeforeKB, 0LL);
+        tusDone++;
+
+        bool recycle = (options_.maxTUsPerWorker > 0 && tusDone >= options_.maxTUsPerWorker) ||
+                       (options_.maxWorkerRssMB > 0 &&
+                        rssKB > static_cast<long long>(options_.maxWorkerRssMB) * 1024);
+
+        std::string result = std::to_string(index) + " " + (ok ? "1" : "0") + " " +
+                             std::to_string(elapsedMs) + " " + std::to_string(rssKB) + " " +
+                             std::to_string(peakKB) + " " + (recycle ? "1" : "0") + "\n";
+        if (write(resultFd, result.data(), result.size()) != static_cast<ssize_t>(result.size())) {
+            break;
+        }
+        if (recycle) {
+            break;
+        }
+    }
+
+    fclose(in);
+    close(resultFd);
+}
+
+bool TUScheduler::dispatch(Worker& worker, std::vector<size_t>& pending) {
+    size_t choice = 0;
+    if (options_.memoryBudgetMB > 0) {
+        long long budgetKB = static_cast<long long>(options_.memoryBudgetMB) * 1024;
+        long long usedKB = committedRssKB();
+
+        // Largest pending TU that still fits in the budget
+        choice = pending.size();
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (usedKB + tasks_[pending[i]].estimatedRssKB <= budgetKB) {
+                choice = i;
+                break;
+            }
+        }
+        if (choice == pending.size()) {
+            bool othersBusy = std::any_of(workers_.begin(), workers_.end(),
+                                          [](const Worker& w) { return w.currentTask >= 0; });
+            if (othersBusy) {
+                return false;
+            }
+            // Nothing is running, so nothing will free memory: make progress
+            choice = 0;
+        }
+    }
+
+    size_t task = pending[choice];
+    std::string line = std::to_string(task) + "\n";
+    if (write(worker.taskFd, line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+        return false;
+    }
+
+    pending.erase(pending.begin() + choice);
+    worker.currentTask = static_cast<int>(task);
+    worker.started = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool TUScheduler::readResults(Worker& worker) {
+    char buf[4096];
+    ssize_t n = read(worker.resultFd, buf, sizeof(buf));
+    if (n <= 0) {
+        return false;
+    }
+
+    worker.buffer.append(buf, n);
+    size_t pos;
+    while ((pos = worker.buffer.find('\n')) != std::string::npos) {
+        handleResult(worker, worker.buffer.substr(0, pos));
+        worker.buffer.erase(0, pos + 1);
+    }
+    return true;
+}
+
+void TUScheduler::handleResult(Worker& worker, const std::string& line) {
+    std::istringstream in(line);
+    size_t index;
+    int ok, recycle;
+    long long elapsedMs, rssKB, peakRssKB;
+    if (!(in >> index >> ok >> elapsedMs >> rssKB >> peakRssKB >> recycle) || index >= tasks_.size()) {
+        return;
+    }
+
+    ProjectDB::TUStats stats;
+    stats.parseMs = elapsedMs;
+    stats.peakRssKB = peakRssKB;
+    stats.status = ok ? "ok" : "failed";
+    recordStats(tasks_[index].path, stats);
+    if (!ok) {
+        failed_.push_back(tasks_[index].path);
+    }
+
+    worker.currentTask = -1;
+    worker.rssKB = rssKB;
+    worker.tusDone++;
+    worker.retiring = recycle != 0;
+}
+
+void TUScheduler::retireWorker(size_t index) {
+    Worker& worker = workers_[index];
+    close(worker.taskFd);
+    close(worker.resultFd);
+
+    int status = 0;
+    waitpid(worker.pid, &status, 0);
+
+    // The worker died while analyzing a TU
+    if (worker.currentTask >= 0) {
+        const Task& task = tasks_[worker.currentTask];
+        if (WIFSIGNALED(status)) {
+            std::cerr << "Worker crashed with signal " << WTERMSIG(status)
+                      << " while analyzing " << task.path << std::endl;
+        } else {
+            std::cerr << "Worker exited while analyzing " << task.path << std::endl;
+        }
+
+        ProjectDB::TUStats stats;
+        stats.parseMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - worker.started).count();
+        stats.peakRssKB = worker.rssKB;
+        stats.status = "crashed";
+        recordStats(task.path, stats);
+        failed_.push_back(task.path + " (crashed)");
+    }
+
+    workers_.erase(workers_.begin() + index);
+}
+
+void TUScheduler::recordStats(const std::string& path, const ProjectDB::TUStats& stats) {
+    // Opened per update so no connection is ever inherited by a forked worker
+    ProjectDB db(dbPath_);
+    if (!db.storeTUStats(path, stats)) {
+        std::cerr << "Failed to record statistics for " << path << std::endl;
+    }
+}
+
+long long TUScheduler::committedRssKB() const {
+    long long total = 0;
+    for (const auto& worker : workers_) {
+        total += std::max(worker.rssKB, currentRssKB(worker.pid));
+    }
+    return total;
+}
+
+long long TUScheduler::estimateCostMs(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        return 0;
+    }
+
+    // Headers dominate parse time, so includes weigh far more than raw size
+    long long bytes = 0;
+    long long includes = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        bytes += line.size() + 1;
+        size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line.compare(first, 8, "#include") == 0) {
+            includes++;
+        }
+    }
+    return bytes / 1024 + includes * 50;
+}
+
+bool TUScheduler::resetPeakRss() {
+    // Writing 5 resets VmHWM (Linux 4.0+)
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.flush();
+    return clearRefs.good();
+}
+
+long long TUScheduler::peakRssKB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtoll(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+long long TUScheduler::currentRssKB(pid_t pid) {
+    std::ifstream statm("/proc/" + std::to_string(pid) + "/statm");
+    long long sizePages = 0, residentPages = 0;
+    if (!(statm >> sizePages >> residentPages)) {
+        return 0;
+    }
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
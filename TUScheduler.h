@@ -0,0 +1,81 @@
+#pragma once
+#include <sys/types.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ProjectDB.h"
+
+// Runs many translation units across forked worker processes.
+//
+// TUs are dispatched longest-first, using the parse time recorded in the
+// tu_stats table or, for unseen files, an estimate from file size and include
+// count. Workers are recycled after a number of TUs or once their RSS exceeds a
+// limit, and new work is held back while the workers' combined RSS would exceed
+// the global budget. Every TU commits its own results, so a crashing TU only
+// loses itself; it is recorded as "crashed" and its worker is replaced.
+class TUScheduler {
+public:
+    struct Options {
+        unsigned workers = 1;
+        unsigned maxTUsPerWorker = 0;   // 0: never recycle by count
+        size_t maxWorkerRssMB = 0;      // 0: never recycle by memory
+        size_t memoryBudgetMB = 0;      // 0: no global budget
+    };
+
+    // Analyzes one TU inside a worker; returns false on failure
+    using TUHandler = std::function<bool(const std::string& sourceFile)>;
+
+    // Called from the scheduling loop at least once a second
+    using TickHandler = std::function<void()>;
+
+    TUScheduler(const std::string& dbPath, const Options& options);
+
+    void setTickHandler(const TickHandler& tick) { tick_ = tick; }
+
+    // Returns true if every TU succeeded
+    bool run(const std::vector<std::string>& sources, const TUHandler& handler);
+
+private:
+    struct Task {
+        std::string path;
+        long long estimatedMs;
+        long long estimatedRssKB;
+    };
+
+    struct Worker {
+        pid_t pid = -1;
+        int taskFd = -1;
+        int resultFd = -1;
+        int currentTask = -1;
+        long long rssKB = 0;
+        unsigned tusDone = 0;
+        bool retiring = false;
+        std::chrono::steady_clock::time_point started;
+        std::string buffer;
+    };
+
+    std::string dbPath_;
+    Options options_;
+    TickHandler tick_;
+    std::vector<Task> tasks_;
+    std::vector<Worker> workers_;
+    std::vector<std::string> failed_;
+
+    void orderTasks(const std::vector<std::string>& sources);
+    bool spawnWorker(const TUHandler& handler);
+    void runWorker(int taskFd, int resultFd, const TUHandler& handler);
+    bool dispatch(Worker& worker, std::vector<size_t>& pending);
+    bool readResults(Worker& worker);
+    void handleResult(Worker& worker, const std::string& line);
+    void retireWorker(size_t index);
+    void recordStats(const std::string& path, const ProjectDB::TUStats& stats);
+    long long committedRssKB() const;
+
+    static long long estimateCostMs(const std::string& path);
+    static long long currentRssKB(pid_t pid);
+    // High-water mark of this process since the last resetPeakRss()
+    static bool resetPeakRss();
+    static long long peakRssKB();
+};
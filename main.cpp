@@ -1,9 +1,27 @@
 #include <clang-c/Index.h>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 #include <map>
 #include <set>
+#include <unordered_set>
+#include "ASTCache.h"
 #include "ASTSerializer.h"
+#include "CalleeClassifier.h"
+#include "CallGraph.h"
+#include "CallGraphDiff.h"
+#include "CallPathQuery.h"
+#include "ColumnarExporter.h"
+#include "CompileCommands.h"
+#include "EventStream.h"
+#include "HotPathQuery.h"
+#include "ProfileImporter.h"
+#include "ProjectDB.h"
+#include "ShardCoordinator.h"
+#include "TUScheduler.h"
 
 std::string getCursorSpelling(CXCursor cursor) {
     CXString name = clang_getCursorSpelling(cursor);
@@ -81,8 +99,24 @@ struct PointerContext {
     }
 };
 
+// What the report visitor writes to
+struct VisitContext {
+    CalleeClassifier* classifier;
+    EventStream* events;
+    // Template specializations by USR, walked after the TU like the
+    // serializer does, see visitCalledSpecializations
+    std::unordered_set<std::string> declaredSpecializations;
+    std::vector<std::pair<CXCursor, std::string>> calledSpecializations;
+};
+
+static const char* cString(CXString string) {
+    const char* result = clang_getCString(string);
+    return result ? result : "";
+}
+
 CXChildVisitResult visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
     static PointerContext ptrContext;
+    auto* context = static_cast<VisitContext*>(client_data);
     
     // 跨文件分析时不跳过非主文件
     CXSourceLocation location = clang_getCursorLocation(cursor);
@@ -91,6 +125,15 @@ CXChildVisitResult visitor(CXCursor cursor, CXCursor parent, CXClientData client
     }
 
     CXCursorKind kind = clang_getCursorKind(cursor);
+
+    bool isFunction = kind == CXCursor_FunctionDecl || kind == CXCursor_CXXMethod ||
+                      kind == CXCursor_Constructor || kind == CXCursor_Destructor ||
+                      kind == CXCursor_ConversionFunction;
+    if (isFunction && !clang_Cursor_isNull(clang_getSpecializedCursorTemplate(cursor))) {
+        CXString usr = clang_getCursorUSR(cursor);
+        context->declaredSpecializations.insert(cString(usr));
+        clang_disposeString(usr);
+    }
     
     // Handle macro expansions
     if (kind == CXCursor_MacroExpansion) {
@@ -112,114 +155,95 @@ CXChildVisitResult visitor(CXCursor cursor, CXCursor parent, CXClientData client
         clang_getFileLocation(defLoc, &defFile, &defLine, &defColumn, nullptr);
         CXString defFileName = clang_getFileName(defFile);
         
-        std::cout << "[macro] " << clang_getCString(macroName) 
-                  << "\n  Defined at: " << clang_getCString(defFileName) << ":" << defLine
-                  << "\n  Expanded at: " << clang_getCString(fileName) << ":" << line << std::endl;
-                  
+        Event event{Event::Macro};
+        event.name = cString(macroName);
+        event.file = cString(fileName);
+        event.line = line;
+        event.definitionFile = cString(defFileName);
+        event.definitionLine = defLine;
+        context->events->emit(event);
+
         clang_disposeString(macroName);
         clang_disposeString(fileName);
         clang_disposeString(defFileName);
-        
-        // Visit macro expansion tokens
-        clang_visitChildren(cursor, visitor, client_data);
+
+        // Expansions have no children; the expanded code is visited in place
         return CXChildVisit_Continue;
     }
     
     // Handle constructor/destructor calls
     if (kind == CXCursor_Constructor || kind == CXCursor_Destructor) {
-        std::string type = (kind == CXCursor_Constructor) ? "[constructor]" : "[destructor]";
         std::string name = getFullQualifiedName(cursor);
-        std::cout << type << " " << name << std::endl;
+        Event event{kind == CXCursor_Constructor ? Event::Constructor : Event::Destructor};
+        event.name = name;
+        context->events->emit(event);
     }
     // Handle exception flow
     else if (kind == CXCursor_CXXTryStmt) {
-        std::cout << "[try-block]" << std::endl;
+        context->events->emit(Event{Event::Try});
     }
     else if (kind == CXCursor_CXXCatchStmt) {
         CXString exceptionType = clang_getCursorSpelling(cursor);
-        std::cout << "[catch] " << clang_getCString(exceptionType) << std::endl;
+        Event event{Event::Catch};
+        event.name = cString(exceptionType);
+        context->events->emit(event);
         clang_disposeString(exceptionType);
     }
     else if (kind == CXCursor_CXXThrowExpr) {
-        std::cout << "[throw]" << std::endl;
+        context->events->emit(Event{Event::Throw});
     }
     // Handle async calls
     // Handle reflection calls
     else if (kind == CXCursor_CXXDynamicCastExpr || 
              kind == CXCursor_CXXTypeidExpr) {
-        std::string type = (kind == CXCursor_CXXDynamicCastExpr) ? 
-                          "[dynamic_cast]" : "[typeid]";
         CXType exprType = clang_getCursorType(cursor);
         CXString typeStr = clang_getTypeSpelling(exprType);
-        std::cout << type << " " << clang_getCString(typeStr) << std::endl;
+        Event event{kind == CXCursor_CXXDynamicCastExpr ? Event::DynamicCast : Event::Typeid};
+        event.name = cString(typeStr);
+        context->events->emit(event);
         clang_disposeString(typeStr);
     }
     // Handle potential incomplete call chains
     else if (kind == CXCursor_CallExpr) {
         // Check for indirect calls through function pointers
         if (clang_Cursor_isDynamicCall(cursor)) {
-            std::cout << "[warning] Dynamic call - call chain may be incomplete" << std::endl;
+            context->events->emit(Event{Event::DynamicCallWarning});
         }
         
+        CXCursor referenced = clang_getCursorReferenced(cursor);
+        if (clang_isInvalid(clang_getCursorKind(referenced))) {
+            return CXChildVisit_Continue;
+        }
+        // Kept for the serializer, which stores the same call
+        CalleeClassifier::Callee classified = context->classifier->classify(cursor, referenced, true);
+        unsigned kinds = classified.kinds;
+        if (kinds & CalleeClassifier::TemplateInstantiation) {
+            context->calledSpecializations.emplace_back(referenced, *classified.usr);
+        }
+
         // Check for calls through virtual tables
-        if (clang_CXXMethod_isVirtual(cursor)) {
-            std::cout << "[warning] Virtual call - runtime target may vary" << std::endl;
+        if (kinds & CalleeClassifier::VirtualDispatch) {
+            context->events->emit(Event{Event::VirtualCallWarning});
         }
-        CXString callExpr = clang_getCursorSpelling(cursor);
-        std::string callStr = clang_getCString(callExpr);
-        clang_disposeString(callExpr);
-        
-        if (callStr.find("std::async") != std::string::npos || 
-            callStr.find("std::thread") != std::string::npos) {
-            std::cout << "[async] " << callStr << std::endl;
+
+        std::string caller = getFullQualifiedName(parent);
+        std::string callee = getFullQualifiedName(referenced);
+
+        if (kinds & CalleeClassifier::AsyncSpawn) {
             // Capture calling context
             CXSourceLocation loc = clang_getCursorLocation(cursor);
             CXFile file;
             unsigned line, column;
             clang_getFileLocation(loc, &file, &line, &column, nullptr);
             CXString fileName = clang_getFileName(file);
-            std::cout << "  Called from: " << clang_getCString(fileName) 
-                      << ":" << line << std::endl;
+            Event event{Event::AsyncSpawn};
+            event.name = callee;
+            event.file = cString(fileName);
+            event.line = line;
+            context->events->emit(event);
             clang_disposeString(fileName);
         }
-        CXCursor referenced = clang_getCursorReferenced(cursor);
-        if (clang_isInvalid(clang_getCursorKind(referenced))) {
-            return CXChildVisit_Continue;
-        }
-
-        std::string caller = getFullQualifiedName(parent);
-        std::string callee = getFullQualifiedName(referenced);
 
-        // Handle inheritance and virtual calls
-        if (clang_getCursorKind(referenced) == CXCursor_CXXMethod) {
-            CXType type = clang_getCursorType(referenced);
-            if (type.kind == CXType_FunctionProto) {
-                // Get full inheritance chain
-                CXCursor baseCursor = clang_getCursorDefinition(referenced);
-                std::string inheritanceChain;
-                
-                // Walk up the inheritance hierarchy
-                CXCursor current = baseCursor;
-                while (!clang_Cursor_isNull(current)) {
-                    CXCursor semanticParent = clang_getCursorSemanticParent(current);
-                    if (clang_getCursorKind(semanticParent) == CXCursor_ClassDecl ||
-                        clang_getCursorKind(semanticParent) == CXCursor_StructDecl) {
-                        
-                        CXString parentName = clang_getCursorSpelling(semanticParent);
-                        inheritanceChain = std::string(clang_getCString(parentName)) + "::" + inheritanceChain;
-                        clang_disposeString(parentName);
-                        
-                        // Check for virtual
-                        if (clang_CXXMethod_isVirtual(current)) {
-                            inheritanceChain = "[virtual] " + inheritanceChain;
-                        }
-                    }
-                    current = semanticParent;
-                }
-                
-                callee = inheritanceChain + callee;
-            }
-        }
         // Handle function pointer calls with pointer analysis
         if (clang_getCursorKind(referenced) == CXCursor_DeclRefExpr) {
             CXType type = clang_getCursorType(referenced);
@@ -250,90 +274,546 @@ CXChildVisitResult visitor(CXCursor cursor, CXCursor parent, CXClientData client
                 ptrContext.addAssignment(lhs, rhs);
             }
         }
-        // Handle lambda expressions
-        else if (clang_getCursorKind(referenced) == CXCursor_LambdaExpr) {
-            callee = "[lambda] " + getCursorSpelling(parent);
-        }
-        // Handle template instantiations
-        else if (clang_getCursorKind(referenced) == CXCursor_FunctionTemplate ||
-                 clang_getCursorKind(referenced) == CXCursor_ClassTemplate) {
-            CXString templName = clang_getCursorSpelling(referenced);
-            callee = "[template] " + std::string(clang_getCString(templName));
-            clang_disposeString(templName);
-            
-            // Get template arguments
-            CXType type = clang_getCursorType(referenced);
-            if (type.kind == CXType_FunctionProto || type.kind == CXType_Unexposed) {
-                CXCursor templCursor = clang_getSpecializedCursorTemplate(referenced);
-                if (!clang_Cursor_isNull(templCursor)) {
-                    CXString args = clang_getTypeSpelling(type);
-                    callee += "<" + std::string(clang_getCString(args)) + ">";
-                    clang_disposeString(args);
-                }
-            }
+        // The sink labels calls by kind; lambdas, templates and operators are
+        // named without their scope
+        else if (kinds & CalleeClassifier::Lambda) {
+            callee = getCursorSpelling(clang_getCursorSemanticParent(referenced));
         }
-        // Handle operator overloads
-        else if (clang_getCursorKind(referenced) == CXCursor_BinaryOperator ||
-                 clang_getCursorKind(referenced) == CXCursor_UnaryOperator ||
-                 clang_getCursorKind(referenced) == CXCursor_CompoundAssignOperator ||
-                 clang_getCursorKind(referenced) == CXCursor_CXXMethod) {
-            CXString opName = clang_getCursorSpelling(referenced);
-            callee = "[operator] " + std::string(clang_getCString(opName));
-            clang_disposeString(opName);
+        // Handle template instantiations: report the primary template only,
+        // specializations are recorded by the serializer
+        else if ((kinds & (CalleeClassifier::TemplateInstantiation | CalleeClassifier::StdFunctionCall)) ==
+                 CalleeClassifier::TemplateInstantiation) {
+            callee = getCursorSpelling(clang_getSpecializedCursorTemplate(referenced));
         }
-        else {
-            callee = getFullQualifiedName(referenced);
+        else if (kinds & CalleeClassifier::Operator) {
+            callee = getCursorSpelling(referenced);
         }
-        
-        std::cout << caller << " -> " << callee << std::endl;
+
+        Event event{Event::Call};
+        event.kinds = kinds;
+        event.name = callee;
+        event.caller = caller;
+        context->events->emit(event);
     }
     
     return CXChildVisit_Recurse;
 }
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <source-file>" << std::endl;
-        return 1;
+// A TU loaded from an AST file doesn't list implicit instantiations among its
+// top-level declarations, a fresh parse does, after everything else. Walking
+// the called ones not seen yet keeps the report of both the same.
+static void visitCalledSpecializations(VisitContext& context) {
+    for (size_t i = 0; i < context.calledSpecializations.size(); i++) {
+        CXCursor callee = context.calledSpecializations[i].first;
+        if (!context.declaredSpecializations.insert(context.calledSpecializations[i].second).second) {
+            continue;
+        }
+        if (visitor(callee, clang_getCursorSemanticParent(callee), &context) == CXChildVisit_Recurse) {
+            clang_visitChildren(callee, visitor, &context);
+        }
     }
+}
+
+struct AnalyzeOptions {
+    bool symbolsOnly = false;
+    bool collapseTemplates = false;
+    std::string dbPath = "callgraph.db";
+    // Per-file arguments; files it does not know use the defaults below
+    const CompileCommands* compileCommands = nullptr;
+    // Reuses parsed TUs across runs when set
+    ASTCache* astCache = nullptr;
+    EventStream::Format eventFormat = EventStream::Format::Text;
+};
 
+static bool analyzeFile(const std::string& sourceFile, const AnalyzeOptions& options) {
     // 创建索引时启用跨文件分析
     CXIndex index = clang_createIndex(1, 1);
-    
+
     // 解析翻译单元时包含所有头文件
-    const char* args[] = {
-        "-I/usr/include",
-        "-I/usr/include/c++/13",
-        "-I/usr/include/x86_64-linux-gnu/c++/13"
-    };
-    
-    CXTranslationUnit unit = clang_parseTranslationUnit(
-        index,
-        argv[1],
-        args, sizeof(args)/sizeof(args[0]),
-        nullptr, 0,
-        CXTranslationUnit_DetailedPreprocessingRecord |
-        CXTranslationUnit_KeepGoing);
-        
+    std::vector<std::string> argStorage;
+    if (options.compileCommands) {
+        argStorage = options.compileCommands->argumentsFor(sourceFile);
+    }
+    if (argStorage.empty()) {
+        argStorage = {
+            "-I/usr/include",
+            "-I/usr/include/c++/13",
+            "-I/usr/include/x86_64-linux-gnu/c++/13"
+        };
+    }
+    std::vector<const char*> args;
+    for (const auto& arg : argStorage) {
+        args.push_back(arg.c_str());
+    }
+
+    // Symbols-only pass: no bodies and no preprocessing record, only declarations
+    unsigned parseOptions = CXTranslationUnit_KeepGoing;
+    if (options.symbolsOnly) {
+        parseOptions |= CXTranslationUnit_SkipFunctionBodies;
+    } else {
+        parseOptions |= CXTranslationUnit_DetailedPreprocessingRecord;
+    }
+
+    std::string parsePath = sourceFile;
+    std::string cacheKey;
+    CXTranslationUnit unit = nullptr;
+    if (options.astCache) {
+        parsePath = ASTCache::absolutePath(sourceFile);
+        cacheKey = options.astCache->key(parsePath, argStorage, parseOptions);
+        unit = options.astCache->load(index, cacheKey);
+    }
+
     if (unit == nullptr) {
-        std::cerr << "Unable to parse translation unit" << std::endl;
-        return 1;
+        unit = clang_parseTranslationUnit(
+            index,
+            parsePath.c_str(),
+            args.data(), static_cast<int>(args.size()),
+            nullptr, 0,
+            parseOptions);
+        if (unit != nullptr && options.astCache) {
+            options.astCache->store(unit, cacheKey);
+        }
+    }
+
+    if (unit == nullptr) {
+        std::cerr << "Unable to parse translation unit: " << sourceFile << std::endl;
+        clang_disposeIndex(index);
+        return false;
     }
 
-    CXCursor cursor = clang_getTranslationUnitCursor(unit);
-    clang_visitChildren(cursor, visitor, nullptr);
+    ASTSerializer serializer(options.dbPath);
+    serializer.setSymbolsOnly(options.symbolsOnly);
+    serializer.setCollapseTemplates(options.collapseTemplates);
+
+    // The report and the serializer classify the same callees
+    if (!options.symbolsOnly) {
+        // One stream per TU: scheduler workers are forked, and a writer
+        // thread does not survive fork
+        EventStream events(options.eventFormat);
+        VisitContext context{&serializer.calleeClassifier(), &events};
+        CXCursor cursor = clang_getTranslationUnitCursor(unit);
+        clang_visitChildren(cursor, visitor, &context);
+        visitCalledSpecializations(context);
+    }
 
     // Save call graph to database
-    ASTSerializer serializer("callgraph.db");
+    bool ok = true;
     if (!serializer.serializeTranslationUnit(unit)) {
         std::cerr << "Failed to serialize translation unit" << std::endl;
+        ok = false;
     }
     if (!serializer.saveToDatabase()) {
         std::cerr << "Failed to save call graph to database" << std::endl;
+        ok = false;
     }
 
     clang_disposeTranslationUnit(unit);
     clang_disposeIndex(index);
-    
+    return ok;
+}
+
+static uint32_t resolveSymbol(const CallGraph& graph, const std::string& symbol) {
+    std::vector<uint32_t> candidates;
+    uint32_t node = graph.findNode(symbol, &candidates);
+    if (node != CallGraph::kNone) {
+        return node;
+    }
+    if (candidates.empty()) {
+        std::cerr << "No function matches " << symbol << std::endl;
+    } else {
+        std::cerr << symbol << " is ambiguous:" << std::endl;
+        for (uint32_t candidate : candidates) {
+            const CallGraph::CallSite& declaration = graph.declaration(candidate);
+            std::cerr << "  " << graph.name(candidate) << "  at " << graph.filePath(declaration.fileId)
+                      << ":" << declaration.line << std::endl;
+        }
+    }
+    return CallGraph::kNone;
+}
+
+static int runPathQuery(int argc, char** argv) {
+    CallPathQuery::Options options;
+    for (int i = 5; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--max-depth") {
+            options.maxDepth = std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (arg == "--max-paths") {
+            options.maxPaths = std::strtoul(argv[i + 1], nullptr, 10);
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    CallGraph graph;
+    if (!ProjectDB::hasCurrentSchema(argv[2]) || !graph.load(argv[2])) {
+        return 1;
+    }
+    uint32_t from = resolveSymbol(graph, argv[3]);
+    uint32_t to = resolveSymbol(graph, argv[4]);
+    if (from == CallGraph::kNone || to == CallGraph::kNone) {
+        return 1;
+    }
+
+    CallPathQuery query(graph);
+    std::vector<CallPathQuery::Path> paths = query.findPaths(from, to, options);
+    if (paths.empty()) {
+        std::cout << "No call path within " << options.maxDepth << " calls" << std::endl;
+        return 0;
+    }
+
+    for (size_t p = 0; p < paths.size(); p++) {
+        const CallPathQuery::Path& path = paths[p];
+        std::cout << "Path " << p + 1 << " (" << path.size() - 1 << " calls):\n"
+                  << "  " << graph.name(path[0]) << "\n";
+        for (size_t i = 0; i + 1 < path.size(); i++) {
+            const CallGraph::CallSite& site = graph.site(graph.findEdge(path[i], path[i + 1]));
+            std::cout << "    -> " << graph.name(path[i + 1]) << "  at "
+                      << graph.filePath(site.fileId) << ":" << site.line << "\n";
+        }
+    }
+    std::cout.flush();
     return 0;
 }
+
+static int runProfileImport(int argc, char** argv) {
+    bool replace = argc == 5 && std::string(argv[4]) == "--replace";
+    if (argc == 5 && !replace) {
+        std::cerr << "Unknown option " << argv[4] << std::endl;
+        return 1;
+    }
+
+    CallGraph graph;
+    if (!ProjectDB::hasCurrentSchema(argv[2]) || !graph.load(argv[2])) {
+        return 1;
+    }
+    ProfileImporter importer(graph);
+    if (!importer.import(argv[3])) {
+        return 1;
+    }
+    std::cout << "Read " << importer.samples() << " samples, " << importer.unresolvedFrames()
+              << " of " << importer.frames() << " frames did not match an indexed function" << std::endl;
+    if (!importer.save(argv[2], replace)) {
+        std::cerr << "Failed to store profile" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static int runHotPathQuery(int argc, char** argv) {
+    HotPathQuery::Options options;
+    for (int i = 4; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--max-depth") {
+            options.maxDepth = std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (arg == "--max-paths") {
+            options.maxPaths = std::strtoul(argv[i + 1], nullptr, 10);
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    CallGraph graph;
+    if (!ProjectDB::hasCurrentSchema(argv[2]) || !graph.load(argv[2])) {
+        return 1;
+    }
+    uint32_t target = resolveSymbol(graph, argv[3]);
+    if (target == CallGraph::kNone) {
+        return 1;
+    }
+    HotPathQuery query(graph);
+    if (!query.load(argv[2])) {
+        return 1;
+    }
+
+    std::vector<HotPathQuery::Path> paths = query.hottestPathsInto(target, options);
+    if (paths.empty()) {
+        std::cout << "No profiled calls into " << graph.name(target) << std::endl;
+        return 0;
+    }
+    for (size_t p = 0; p < paths.size(); p++) {
+        const HotPathQuery::Path& path = paths[p];
+        std::cout << "Path " << p + 1 << " (weight " << path.weight << "):\n"
+                  << "  " << graph.name(path.nodes[0]) << "\n";
+        for (size_t i = 0; i + 1 < path.nodes.size(); i++) {
+            std::cout << "    -> " << graph.name(path.nodes[i + 1]) << "  [" << path.weights[i] << "]";
+            uint32_t edge = graph.findEdge(path.nodes[i], path.nodes[i + 1]);
+            if (edge != CallGraph::kNone) {
+                const CallGraph::CallSite& site = graph.site(edge);
+                std::cout << "  at " << graph.filePath(site.fileId) << ":" << site.line;
+            }
+            std::cout << "\n";
+        }
+    }
+    std::cout.flush();
+    return 0;
+}
+
+static int runDiff(const std::string& oldPath, const std::string& newPath) {
+    // The snapshots are only read; older ones have to be migrated first
+    if (!ProjectDB::hasCurrentSchema(oldPath) || !ProjectDB::hasCurrentSchema(newPath)) {
+        return 1;
+    }
+
+    CallGraphDiff diff;
+    if (!diff.load(oldPath, newPath)) {
+        return 1;
+    }
+    CallGraphDiff::Counts counts = diff.write(std::cout);
+    std::cerr << counts.added << " added, " << counts.removed << " removed, " << counts.changed
+              << " changed edges" << std::endl;
+    return 0;
+}
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] <source-file>...\n"
+              << "       " << prog << " migrate <db>\n"
+              << "       " << prog << " export-columnar <db> <out-file>\n"
+              << "       " << prog << " paths <db> <from> <to> [--max-depth N] [--max-paths K]\n"
+              << "       " << prog << " import-profile <db> <perf-script|collapsed|-> [--replace]\n"
+              << "       " << prog << " hot-paths <db> <function> [--max-depth N] [--max-paths K]\n"
+              << "       " << prog << " diff <old-db> <new-db>\n"
+              << "       " << prog << " coordinate <work-dir> [options] [source-file...]\n"
+              << "       " << prog << " worker <work-dir> [options]\n"
+              << "       " << prog << " merge <work-dir> <out-db>\n"
+              << "Options:\n"
+              << "  --symbols-only          index declarations only\n"
+              << "  --collapse-templates    one edge per (caller, primary template)\n"
+              << "  --jobs N                analyze TUs in N worker processes\n"
+              << "  --recycle-after N       restart a worker after N TUs\n"
+              << "  --recycle-rss-mb N      restart a worker once its RSS exceeds N MB\n"
+              << "  --memory-budget-mb N    cap the combined RSS of all workers\n"
+              << "  --compile-db DIR        take sources and flags from DIR/compile_commands.json\n"
+              << "  --events FORMAT         report as text (default), ndjson or binary records\n"
+              << "  --ast-cache DIR         reuse parsed TUs saved in DIR across runs\n"
+              << "  --ast-cache-mb N        evict least recently used TUs beyond N MB (default 4096)\n"
+              << "Coordinate options:\n"
+              << "  --unit-size N           TUs per work unit (default 16)\n"
+              << "  --local-workers N       worker processes to start on this host\n"
+              << "  --stale-seconds N       take over units without a heartbeat for N seconds\n"
+              << "  -o FILE                 merged database (default callgraph.db)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "export-columnar") {
+        if (argc != 4) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        // Exporting must not rewrite the source database
+        if (!ProjectDB::hasCurrentSchema(argv[2])) {
+            return 1;
+        }
+        ColumnarExporter exporter(argv[2]);
+        if (!exporter.exportTo(argv[3])) {
+            std::cerr << "Failed to export call graph" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "migrate") {
+        if (argc != 3) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (!std::ifstream(argv[2])) {
+            std::cerr << "Can't open database: " << argv[2] << std::endl;
+            return 1;
+        }
+        ProjectDB db(argv[2]);
+        return db.initializeSchema() ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "paths") {
+        if (argc < 5 || argc % 2 == 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runPathQuery(argc, argv);
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "import-profile") {
+        if (argc != 4 && argc != 5) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runProfileImport(argc, argv);
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "hot-paths") {
+        if (argc < 4 || argc % 2 != 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runHotPathQuery(argc, argv);
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "diff") {
+        if (argc != 4) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runDiff(argv[2], argv[3]);
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "merge") {
+        if (argc != 4) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        ShardCoordinator coordinator(argv[2]);
+        return coordinator.mergeShards(argv[3]) ? 0 : 1;
+    }
+
+    // coordinate and worker take the work directory before the options
+    std::string command;
+    std::string workDir;
+    int first = 1;
+    if (argc > 2 && (std::string(argv[1]) == "coordinate" || std::string(argv[1]) == "worker")) {
+        command = argv[1];
+        workDir = argv[2];
+        first = 3;
+    }
+
+    AnalyzeOptions options;
+    TUScheduler::Options schedulerOptions;
+    bool useScheduler = false;
+    std::string compileDbDir;
+    size_t unitSize = 16;
+    unsigned localWorkers = 0;
+    unsigned staleSeconds = 600;
+    std::string astCacheDir;
+    unsigned long long astCacheMB = 4096;
+    std::vector<std::string> passthroughArgs;
+    std::vector<std::string> sourceFiles;
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--symbols-only") {
+            options.symbolsOnly = true;
+            passthroughArgs.push_back(arg);
+        } else if (arg == "--collapse-templates") {
+            options.collapseTemplates = true;
+            passthroughArgs.push_back(arg);
+        } else if (arg == "--jobs" && hasValue) {
+            schedulerOptions.workers = std::strtoul(argv[++i], nullptr, 10);
+            passthroughArgs.insert(passthroughArgs.end(), {arg, argv[i]});
+            useScheduler = true;
+        } else if (arg == "--recycle-after" && hasValue) {
+            schedulerOptions.maxTUsPerWorker = std::strtoul(argv[++i], nullptr, 10);
+            passthroughArgs.insert(passthroughArgs.end(), {arg, argv[i]});
+            useScheduler = true;
+        } else if (arg == "--recycle-rss-mb" && hasValue) {
+            schedulerOptions.maxWorkerRssMB = std::strtoul(argv[++i], nullptr, 10);
+            passthroughArgs.insert(passthroughArgs.end(), {arg, argv[i]});
+            useScheduler = true;
+        } else if (arg == "--memory-budget-mb" && hasValue) {
+            schedulerOptions.memoryBudgetMB = std::strtoul(argv[++i], nullptr, 10);
+            passthroughArgs.insert(passthroughArgs.end(), {arg, argv[i]});
+            useScheduler = true;
+        } else if (arg == "--events" && hasValue) {
+            if (!EventStream::parseFormat(argv[++i], options.eventFormat)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            passthroughArgs.insert(passthroughArgs.end(), {arg, argv[i]});
+        } else if (arg == "--ast-cache" && hasValue) {
+            astCacheDir = argv[++i];
+            passthroughArgs.insert(passthroughArgs.end(), {arg, argv[i]});
+        } else if (arg == "--ast-cache-mb" && hasValue) {
+            astCacheMB = std::strtoull(argv[++i], nullptr, 10);
+            passthroughArgs.insert(passthroughArgs.end(), {arg, argv[i]});
+        } else if (arg == "--compile-db" && hasValue) {
+            compileDbDir = argv[++i];
+        } else if (arg == "--unit-size" && hasValue && command == "coordinate") {
+            unitSize = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--local-workers" && hasValue && command == "coordinate") {
+            localWorkers = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--stale-seconds" && hasValue && !command.empty()) {
+            staleSeconds = std::strtoul(argv[++i], nullptr, 10);
+            passthroughArgs.insert(passthroughArgs.end(), {arg, argv[i]});
+        } else if (arg == "-o" && hasValue && command == "coordinate") {
+            options.dbPath = argv[++i];
+        } else if (arg.compare(0, 1, "-") == 0) {
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            sourceFiles.push_back(arg);
+        }
+    }
+
+    std::unique_ptr<ASTCache> astCache;
+    if (!astCacheDir.empty()) {
+        astCache.reset(new ASTCache(astCacheDir, astCacheMB * 1024 * 1024));
+        options.astCache = astCache.get();
+    }
+
+    std::unique_ptr<ShardCoordinator> coordinator;
+    if (!command.empty()) {
+        coordinator.reset(new ShardCoordinator(workDir, staleSeconds));
+        // Workers read the compilation database recorded by the coordinator
+        if (compileDbDir.empty()) {
+            compileDbDir = coordinator->compileDbDir();
+        }
+    }
+
+    CompileCommands compileCommands;
+    if (!compileDbDir.empty()) {
+        if (!compileCommands.load(compileDbDir)) {
+            return 1;
+        }
+        options.compileCommands = &compileCommands;
+        if (sourceFiles.empty() && command != "worker") {
+            sourceFiles = compileCommands.files();
+        }
+    }
+
+    if (command == "worker") {
+        // Each unit goes into its own shard database
+        bool ok = coordinator->runWorker([options](const std::string& sourceFile, const std::string& dbPath) {
+            AnalyzeOptions shardOptions = options;
+            shardOptions.dbPath = dbPath;
+            return analyzeFile(sourceFile, shardOptions);
+        }, schedulerOptions);
+        return ok ? 0 : 1;
+    }
+
+    if (sourceFiles.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (command == "coordinate") {
+        if (!coordinator->createUnits(sourceFiles, unitSize, compileDbDir)) {
+            return 1;
+        }
+
+        std::vector<std::string> workerCommand = {"/proc/self/exe", "worker", workDir};
+        workerCommand.insert(workerCommand.end(), passthroughArgs.begin(), passthroughArgs.end());
+        if (localWorkers > 0 && !coordinator->launchLocalWorkers(workerCommand, localWorkers)) {
+            return 1;
+        }
+
+        auto handler = [options](const std::string& sourceFile, const std::string& dbPath) {
+            AnalyzeOptions shardOptions = options;
+            shardOptions.dbPath = dbPath;
+            return analyzeFile(sourceFile, shardOptions);
+        };
+        // A partial index is still merged, but the exit status reports it
+        bool ok = coordinator->waitForUnits(handler, schedulerOptions);
+        ok = coordinator->mergeShards(options.dbPath) && ok;
+        return ok ? 0 : 1;
+    }
+
+    if (sourceFiles.size() == 1 && !useScheduler) {
+        return analyzeFile(sourceFiles[0], options) ? 0 : 1;
+    }
+
+    TUScheduler scheduler(options.dbPath, schedulerOptions);
+    bool ok = scheduler.run(sourceFiles, [&options](const std::string& sourceFile) {
+        return analyzeFile(sourceFile, options);
+    });
+    return ok ? 0 : 1;
+}